@@ -15,8 +15,13 @@
  *   - Off-screen OpenGL rendering
  *   - Compatible with standard OSMesa API
  *   - Native implementation via BGLView
- *   - Thread-safe context management
+ *   - Thread-safe context management, the current context is per thread
  *   - Support for BGRA pixel format
+ *   - Optional pipelined readback through pixel pack buffers, enabled with
+ *     OSMesaPixelStore(OSMESA_READBACK_BUFFERS, 2 or 3); the pixels in the
+ *     buffer then lag that many frames minus one behind
+ *   - Partial readback of damaged rectangles with OSMesaSwapBuffersRects()
+ *   - BGLViews sized to the surface and grown on demand
  * 
  * EXAMPLE:
  *   OSMesaContext ctx = OSMesaCreateContext(OSMESA_BGRA, NULL);
@@ -52,6 +57,7 @@ extern "C" {
 
 #define OSMESA_ROW_LENGTH	0x10
 #define OSMESA_Y_UP		0x11
+#define OSMESA_READBACK_BUFFERS	0x12	/* Haiku extension */
 
 #define OSMESA_WIDTH		0x20
 #define OSMESA_HEIGHT		0x21
@@ -69,6 +75,10 @@ extern "C" {
 #define OSMESA_CONTEXT_MAJOR_VERSION 0x36
 #define OSMESA_CONTEXT_MINOR_VERSION 0x37
 
+#ifndef GL_PACK_INVERT_MESA
+#define GL_PACK_INVERT_MESA 0x8758
+#endif
+
 typedef struct osmesa_context *OSMesaContext;
 typedef void (*OSMESAproc)();
 
@@ -86,6 +96,7 @@ GLAPI OSMESAproc GLAPIENTRY OSMesaGetProcAddress( const char *funcName );
 GLAPI void GLAPIENTRY OSMesaColorClamp(GLboolean enable);
 GLAPI void GLAPIENTRY OSMesaPostprocess(OSMesaContext osmesa, const char *filter, unsigned enable_value);
 GLAPI void GLAPIENTRY OSMesaSwapBuffers(OSMesaContext ctx);
+GLAPI void GLAPIENTRY OSMesaSwapBuffersRects(OSMesaContext ctx, const GLint *rects, GLsizei count);
 
 #ifdef __cplusplus
 }
@@ -99,13 +110,26 @@ GLAPI void GLAPIENTRY OSMesaSwapBuffers(OSMesaContext ctx);
 #include <Autolock.h>
 #include <OS.h>
 #include <Screen.h>
-#include <map>
+#include <unordered_map>
+#include <string>
 #include <cstring>
 #include <algorithm>
+#include <cstdio>
+
+#define OSMESA_CONTEXT_MAGIC	0x4f534d43	/* 'OSMC' */
+
+// Views grow in steps of this many pixels, up to the screen size. They
+// are not reused across contexts: a BGLView carries its Mesa context, and
+// with it every GL object and state of the context that is destroyed.
+#define OSMESA_VIEW_STEP	128
 
 struct OSMesaContextRec {
+	uint32 magic;
 	BGLView* glView;
+	GLsizei viewWidth;
+	GLsizei viewHeight;
 	void* userBuffer;
+	GLint rowLength;
 	GLenum format;
 	GLsizei width;
 	GLsizei height;
@@ -114,12 +138,29 @@ struct OSMesaContextRec {
 	GLint accumBits;
 	GLboolean yUp;
 	GLboolean contextLocked;
+	thread_id currentThread;
+	GLboolean destroyPending;
 	GLsizei maxWidth;
 	GLsizei maxHeight;
+	GLint packInvert;
+	unsigned char* flipRow;
+	GLint readbackBuffers;
+	GLint asyncReadback;
+	GLuint packBuffers[3];
+	GLsync packFences[3];
+	GLsizei packWidth;
+	GLsizei packHeight;
+	void* packTarget;
+	int packIndex;
+	std::unordered_map<std::string, OSMESAproc> procCache;
 	
 	OSMesaContextRec() {
+		magic = OSMESA_CONTEXT_MAGIC;
 		glView = NULL;
+		viewWidth = 0;
+		viewHeight = 0;
 		userBuffer = NULL;
+		rowLength = 0;
 		format = OSMESA_BGRA;
 		width = 0;
 		height = 0;
@@ -128,6 +169,20 @@ struct OSMesaContextRec {
 		accumBits = 0;
 		yUp = GL_TRUE;
 		contextLocked = GL_FALSE;
+		currentThread = -1;
+		destroyPending = GL_FALSE;
+		packInvert = -1;
+		flipRow = NULL;
+		readbackBuffers = 1;
+		asyncReadback = -1;
+		packWidth = 0;
+		packHeight = 0;
+		packTarget = NULL;
+		packIndex = 0;
+		for (int i = 0; i < 3; i++) {
+			packBuffers[i] = 0;
+			packFences[i] = 0;
+		}
 		
 		BScreen screen(B_MAIN_SCREEN_ID);
 		BRect frame = screen.Frame();
@@ -138,20 +193,44 @@ struct OSMesaContextRec {
 		if (maxHeight < 512) maxHeight = 512;
 	}
 						
+	// Only deleted once no thread has it current.
 	~OSMesaContextRec() {
-		if (contextLocked && glView) {
-			glView->UnlockGL();
-			contextLocked = GL_FALSE;
-		}
 		delete glView;
 		glView = NULL;
+		free(flipRow);
+		magic = 0;
 	}
 };
 
-static std::map<OSMesaContext, OSMesaContextRec*> g_contexts;
-static OSMesaContext g_currentContext = NULL;
+// Creation, destruction and the currentThread of contexts are serialized,
+// everything else works on the context current in the calling thread.
+static thread_local OSMesaContextRec* g_currentContext = NULL;
 static BLocker g_contextLock("OSMesa Context Lock");
 
+static inline OSMesaContextRec* ValidContext(OSMesaContext handle) {
+	OSMesaContextRec* context = (OSMesaContextRec*)handle;
+	return (context && context->magic == OSMESA_CONTEXT_MAGIC) ? context : NULL;
+}
+
+// Lets go of the context of the calling thread, and deletes it if another
+// thread destroyed it in the meantime.
+static void ReleaseCurrent() {
+	OSMesaContextRec* current = g_currentContext;
+	g_currentContext = NULL;
+	if (!current)
+		return;
+
+	if (current->contextLocked && current->glView) {
+		current->glView->UnlockGL();
+		current->contextLocked = GL_FALSE;
+	}
+
+	BAutolock lock(g_contextLock);
+	current->currentThread = -1;
+	if (current->destroyPending)
+		delete current;
+}
+
 static ulong GetBGLOptions(GLint depthBits, GLint stencilBits, GLint accumBits, GLboolean shareContext) {
 	ulong options = BGL_SINGLE | BGL_RGB | BGL_ALPHA;
 	
@@ -166,6 +245,145 @@ static ulong GetBGLOptions(GLint depthBits, GLint stencilBits, GLint accumBits,
 	return options;
 }
 
+static GLboolean HasPackInvert(OSMesaContextRec* context) {
+	if (context->packInvert < 0) {
+		context->packInvert = 0;
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+		if (extensions) {
+			context->packInvert = strstr(extensions, "GL_MESA_pack_invert") != NULL;
+		} else {
+			// Core profiles only list extensions one by one.
+			glGetError();
+			GLint count = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+			for (GLint i = 0; i < count && !context->packInvert; i++) {
+				const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+				context->packInvert = name && strcmp(name, "GL_MESA_pack_invert") == 0;
+			}
+		}
+	}
+	return context->packInvert ? GL_TRUE : GL_FALSE;
+}
+
+static GLboolean HasAsyncReadback(OSMesaContextRec* context) {
+	// Pixel pack buffers are core since 2.1, fences since 3.2.
+	if (context->asyncReadback < 0) {
+		int major = 0, minor = 0;
+		const char* version = (const char*)glGetString(GL_VERSION);
+		if (version)
+			sscanf(version, "%d.%d", &major, &minor);
+		context->asyncReadback = major > 3 || (major == 3 && minor >= 2);
+	}
+	return context->asyncReadback ? GL_TRUE : GL_FALSE;
+}
+
+static void DropPackFences(OSMesaContextRec* context) {
+	for (int i = 0; i < 3; i++) {
+		if (context->packFences[i]) {
+			glDeleteSync(context->packFences[i]);
+			context->packFences[i] = 0;
+		}
+	}
+}
+
+// Pixels per row of the user buffer, OSMESA_ROW_LENGTH or the width.
+static inline GLint RowLength(OSMesaContextRec* context) {
+	return context->rowLength > context->width ? context->rowLength : context->width;
+}
+
+static void CopyRows(unsigned char* target, GLint targetRowLength, const unsigned char* source,
+	GLsizei width, GLsizei height, GLboolean flip) {
+	size_t rowBytes = (size_t)width * 4;
+	size_t targetStride = (size_t)targetRowLength * 4;
+	if (!flip && targetStride == rowBytes) {
+		memcpy(target, source, rowBytes * height);
+		return;
+	}
+	for (int y = 0; y < height; y++) {
+		int sourceRow = flip ? height - 1 - y : y;
+		memcpy(target + y * targetStride, source + sourceRow * rowBytes, rowBytes);
+	}
+}
+
+// Queues the readback of the current frame into a pack buffer and copies
+// the oldest queued frame into the user buffer. Returns GL_FALSE if the
+// frame has to be read back synchronously instead, which is also the case
+// for the first frame after the size or the user buffer changed.
+static GLboolean ReadPixelsAsync(OSMesaContextRec* context) {
+	if (context->readbackBuffers < 2 || !HasAsyncReadback(context))
+		return GL_FALSE;
+
+	const int count = std::min(context->readbackBuffers, 3);
+	const GLsizeiptr size = (GLsizeiptr)context->width * context->height * 4;
+
+	if (context->packBuffers[0] == 0)
+		glGenBuffers(3, context->packBuffers);
+
+	if (context->packWidth != context->width || context->packHeight != context->height
+		|| context->packTarget != context->userBuffer) {
+		DropPackFences(context);
+		for (int i = 0; i < count; i++) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, context->packBuffers[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		context->packWidth = context->width;
+		context->packHeight = context->height;
+		context->packTarget = context->userBuffer;
+		context->packIndex = 0;
+		return GL_FALSE;
+	}
+
+	const GLboolean invert = context->yUp && HasPackInvert(context);
+	const int index = context->packIndex;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, context->packBuffers[index]);
+	if (invert)
+		glPixelStorei(GL_PACK_INVERT_MESA, GL_TRUE);
+	glReadPixels(0, 0, context->width, context->height, GL_BGRA, GL_UNSIGNED_BYTE, (void*)0);
+	if (invert)
+		glPixelStorei(GL_PACK_INVERT_MESA, GL_FALSE);
+	context->packFences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// The slot written next holds the oldest frame.
+	context->packIndex = (index + 1) % count;
+	const int oldest = context->packIndex;
+
+	if (context->packFences[oldest]) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, context->packBuffers[oldest]);
+		glClientWaitSync(context->packFences[oldest], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+		glDeleteSync(context->packFences[oldest]);
+		context->packFences[oldest] = 0;
+
+		const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if (pixels) {
+			CopyRows((unsigned char*)context->userBuffer, RowLength(context), (const unsigned char*)pixels,
+				context->width, context->height, context->yUp && !invert);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return GL_TRUE;
+}
+
+static GLsizei RoundUpToViewStep(GLsizei value, GLsizei limit) {
+	return std::min(((value + OSMESA_VIEW_STEP - 1) / OSMESA_VIEW_STEP) * OSMESA_VIEW_STEP, limit);
+}
+
+// Called with the context current, makes the view cover width x height.
+static void GrowView(OSMesaContextRec* context, GLsizei width, GLsizei height) {
+	if (width <= context->viewWidth && height <= context->viewHeight)
+		return;
+
+	context->viewWidth = RoundUpToViewStep(std::max(width, context->viewWidth), context->maxWidth);
+	context->viewHeight = RoundUpToViewStep(std::max(height, context->viewHeight), context->maxHeight);
+
+	// The view is not attached to a window, nobody else tells it.
+	context->glView->ResizeTo(context->viewWidth - 1, context->viewHeight - 1);
+	context->glView->FrameResized(context->viewWidth - 1, context->viewHeight - 1);
+}
+
 extern "C" {
 
 #endif
@@ -188,18 +406,22 @@ OSMesaCreateContextExt(GLenum format, GLint depthBits, GLint stencilBits, GLint
 	GLboolean hasShare = (sharelist != NULL) ? GL_TRUE : GL_FALSE;
 	ulong options = GetBGLOptions(depthBits, stencilBits, accumBits, hasShare);
 	
-	ctx->glView = new BGLView(BRect(0, 0, ctx->maxWidth - 1, ctx->maxHeight - 1), 
+	// Start small, MakeCurrent grows the view to the surface.
+	ctx->glView = new BGLView(BRect(0, 0, OSMESA_VIEW_STEP - 1, OSMESA_VIEW_STEP - 1),
 							 "OSMesa", B_FOLLOW_NONE, B_WILL_DRAW, options);
 	
+	if (ctx->glView) {
+		BRect bounds = ctx->glView->Bounds();
+		ctx->viewWidth = bounds.IntegerWidth() + 1;
+		ctx->viewHeight = bounds.IntegerHeight() + 1;
+	}
+	
 	if (!ctx->glView) {
 		delete ctx;
 		return NULL;
 	}
 	
-	OSMesaContext handle = (OSMesaContext)(ctx);
-	g_contexts[handle] = ctx;
-	
-	return handle;
+	return (OSMesaContext)(ctx);
 #else
 	return NULL;
 #endif
@@ -246,58 +468,67 @@ OSMesaCreateContextAttribs(const int *attribList, OSMesaContext sharelist) {
 GLAPI void GLAPIENTRY
 OSMesaDestroyContext(OSMesaContext ctx) {
 #ifdef __cplusplus
-	if (!ctx) return;
+	OSMesaContextRec* context = ValidContext(ctx);
+	if (!context) return;
 	
 	BAutolock lock(g_contextLock);
 	
-	std::map<OSMesaContext, OSMesaContextRec*>::iterator it = g_contexts.find(ctx);
-	if (it != g_contexts.end()) {
-		if (g_currentContext == ctx) {
-			g_currentContext = NULL;
-		}
-		delete it->second;
-		g_contexts.erase(it);
+	if (context->currentThread >= 0 && context->currentThread != find_thread(NULL)) {
+		// Still current on another thread, which holds the view lock and
+		// may use it any time. It deletes the context when letting go.
+		context->magic = 0;
+		context->destroyPending = GL_TRUE;
+		return;
 	}
+	
+	if (g_currentContext == context) {
+		context->destroyPending = GL_TRUE;
+		ReleaseCurrent();
+	} else
+		delete context;
 #endif
 }
 
 GLAPI GLboolean GLAPIENTRY
 OSMesaMakeCurrent(OSMesaContext ctx, void *buffer, GLenum type, GLsizei width, GLsizei height) {
 #ifdef __cplusplus
-	if (!ctx || !buffer || width < 1 || height < 1 || type != GL_UNSIGNED_BYTE) {
-		return GL_FALSE;
+	if (!ctx) {
+		// Releases the context of the calling thread, so another thread
+		// can make it current.
+		ReleaseCurrent();
+		return GL_TRUE;
 	}
 	
-	BAutolock lock(g_contextLock);
-	
-	std::map<OSMesaContext, OSMesaContextRec*>::iterator it = g_contexts.find(ctx);
-	if (it == g_contexts.end()) {
+	if (!buffer || width < 1 || height < 1 || type != GL_UNSIGNED_BYTE) {
 		return GL_FALSE;
 	}
 	
-	OSMesaContextRec* context = it->second;
+	OSMesaContextRec* context = ValidContext(ctx);
+	if (!context || !context->glView) {
+		return GL_FALSE;
+	}
 	
 	if (width > context->maxWidth || height > context->maxHeight) {
 		return GL_FALSE;
 	}
 	
-	if (context->contextLocked && context->glView) {
-		context->glView->UnlockGL();
-		context->contextLocked = GL_FALSE;
+	if (g_currentContext != context) {
+		ReleaseCurrent();
+		// Blocks while another thread has the context current.
+		context->glView->LockGL();
+		context->contextLocked = GL_TRUE;
+		g_currentContext = context;
+		
+		BAutolock lock(g_contextLock);
+		context->currentThread = find_thread(NULL);
 	}
 	
+	GrowView(context, width, height);
+	
 	context->userBuffer = buffer;
 	context->width = width;
 	context->height = height;
 	
-	if (!context->glView) {
-		return GL_FALSE;
-	}
-	
-	context->glView->LockGL();
-	context->contextLocked = GL_TRUE;
-	g_currentContext = ctx;
-	
 	glViewport(0, 0, width, height);
 	
 	return GL_TRUE;
@@ -309,7 +540,7 @@ OSMesaMakeCurrent(OSMesaContext ctx, void *buffer, GLenum type, GLsizei width, G
 GLAPI OSMesaContext GLAPIENTRY
 OSMesaGetCurrentContext(void) {
 #ifdef __cplusplus
-	return g_currentContext;
+	return (OSMesaContext)g_currentContext;
 #else
 	return NULL;
 #endif
@@ -318,19 +549,18 @@ OSMesaGetCurrentContext(void) {
 GLAPI void GLAPIENTRY
 OSMesaPixelStore(GLint pname, GLint value) {
 #ifdef __cplusplus
-	if (!g_currentContext) return;
-	
-	BAutolock lock(g_contextLock);
-	
-	std::map<OSMesaContext, OSMesaContextRec*>::iterator it = g_contexts.find(g_currentContext);
-	if (it != g_contexts.end()) {
-		OSMesaContextRec* context = it->second;
+	OSMesaContextRec* context = g_currentContext;
+	if (context) {
 		switch (pname) {
 			case OSMESA_ROW_LENGTH:
+				context->rowLength = std::max(0, value);
 				break;
 			case OSMESA_Y_UP:
 				context->yUp = value ? GL_TRUE : GL_FALSE;
 				break;
+			case OSMESA_READBACK_BUFFERS:
+				context->readbackBuffers = std::max(1, std::min(value, 3));
+				break;
 		}
 	}
 #endif
@@ -339,13 +569,8 @@ OSMesaPixelStore(GLint pname, GLint value) {
 GLAPI void GLAPIENTRY
 OSMesaGetIntegerv(GLint pname, GLint *value) {
 #ifdef __cplusplus
-	if (!value || !g_currentContext) return;
-	
-	BAutolock lock(g_contextLock);
-	
-	std::map<OSMesaContext, OSMesaContextRec*>::iterator it = g_contexts.find(g_currentContext);
-	if (it != g_contexts.end()) {
-		OSMesaContextRec* context = it->second;
+	OSMesaContextRec* context = g_currentContext;
+	if (value && context) {
 		switch (pname) {
 			case OSMESA_WIDTH:
 				*value = context->width;
@@ -360,11 +585,14 @@ OSMesaGetIntegerv(GLint pname, GLint *value) {
 				*value = GL_UNSIGNED_BYTE;
 				break;
 			case OSMESA_ROW_LENGTH:
-				*value = 0;
+				*value = context->rowLength;
 				break;
 			case OSMESA_Y_UP:
 				*value = context->yUp;
 				break;
+			case OSMESA_READBACK_BUFFERS:
+				*value = context->readbackBuffers;
+				break;
 			case OSMESA_MAX_WIDTH:
 				*value = context->maxWidth;
 				break;
@@ -384,13 +612,8 @@ OSMesaGetDepthBuffer(OSMesaContext c, GLint *width, GLint *height, GLint *bytesP
 GLAPI GLboolean GLAPIENTRY
 OSMesaGetColorBuffer(OSMesaContext c, GLint *width, GLint *height, GLint *format, void **buffer) {
 #ifdef __cplusplus
-	if (!c) return GL_FALSE;
-	
-	BAutolock lock(g_contextLock);
-	
-	std::map<OSMesaContext, OSMesaContextRec*>::iterator it = g_contexts.find(c);
-	if (it != g_contexts.end()) {
-		OSMesaContextRec* context = it->second;
+	OSMesaContextRec* context = ValidContext(c);
+	if (context) {
 		if (width) *width = context->width;
 		if (height) *height = context->height;
 		if (format) *format = context->format;
@@ -404,12 +627,17 @@ OSMesaGetColorBuffer(OSMesaContext c, GLint *width, GLint *height, GLint *format
 GLAPI OSMESAproc GLAPIENTRY
 OSMesaGetProcAddress(const char *funcName) {
 #ifdef __cplusplus
-	if (!g_currentContext) return NULL;
+	OSMesaContextRec* context = g_currentContext;
+	if (!context || !context->glView || !funcName) return NULL;
 	
-	std::map<OSMesaContext, OSMesaContextRec*>::iterator it = g_contexts.find(g_currentContext);
-	if (it != g_contexts.end() && it->second->glView) {
-		return (OSMESAproc)it->second->glView->GetGLProcAddress(funcName);
-	}
+	// Qt resolves hundreds of entry points per context, ask BGLView once.
+	std::unordered_map<std::string, OSMESAproc>::iterator it = context->procCache.find(funcName);
+	if (it != context->procCache.end())
+		return it->second;
+	
+	OSMESAproc proc = (OSMESAproc)context->glView->GetGLProcAddress(funcName);
+	context->procCache[funcName] = proc;
+	return proc;
 #endif
 	return NULL;
 }
@@ -425,47 +653,116 @@ OSMesaPostprocess(OSMesaContext osmesa, const char *filter, unsigned enable_valu
 GLAPI void GLAPIENTRY
 OSMesaSwapBuffers(OSMesaContext ctx) {
 #ifdef __cplusplus
-	if (!ctx) return;
-	
-	BAutolock lock(g_contextLock);
-	
-	std::map<OSMesaContext, OSMesaContextRec*>::iterator it = g_contexts.find(ctx);
-	if (it == g_contexts.end()) return;
-	
-	OSMesaContextRec* context = it->second;
+	OSMesaContextRec* context = ValidContext(ctx);
+	if (!context) return;
 	
 	if (!context->userBuffer || context->width <= 0 || context->height <= 0) {
 		return;
 	}
 	
-	if (g_currentContext != ctx || !context->contextLocked || !context->glView) {
+	if (g_currentContext != context || !context->contextLocked || !context->glView) {
 		return;
 	}
 	
 	glReadBuffer(GL_FRONT);
 	
+	if (ReadPixelsAsync(context))
+		return;
+	
+	glPixelStorei(GL_PACK_ROW_LENGTH, RowLength(context));
+	
+	// Let Mesa write the rows top down while reading back, so the user
+	// buffer is touched only once.
+	if (context->yUp && HasPackInvert(context)) {
+		glPixelStorei(GL_PACK_INVERT_MESA, GL_TRUE);
+		glReadPixels(0, 0, context->width, context->height,
+				   GL_BGRA, GL_UNSIGNED_BYTE, context->userBuffer);
+		glPixelStorei(GL_PACK_INVERT_MESA, GL_FALSE);
+		glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+		return;
+	}
+	
 	glReadPixels(0, 0, context->width, context->height,
 			   GL_BGRA, GL_UNSIGNED_BYTE, context->userBuffer);
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
 	
 	if (context->yUp) {
 		int rowBytes = context->width * 4;
-		unsigned char* temp = (unsigned char*)malloc(rowBytes);
+		size_t stride = (size_t)RowLength(context) * 4;
+		if (!context->flipRow)
+			context->flipRow = (unsigned char*)malloc(context->maxWidth * 4);
+		unsigned char* temp = context->flipRow;
 		if (temp) {
 			unsigned char* pixels = (unsigned char*)context->userBuffer;
 			
 			for (int y = 0; y < context->height / 2; y++) {
-				unsigned char* row1 = pixels + y * rowBytes;
-				unsigned char* row2 = pixels + (context->height - 1 - y) * rowBytes;
+				unsigned char* row1 = pixels + y * stride;
+				unsigned char* row2 = pixels + (context->height - 1 - y) * stride;
 				memcpy(temp, row1, rowBytes);
 				memcpy(row1, row2, rowBytes);
 				memcpy(row2, temp, rowBytes);
 			}
-			free(temp);
 		}
 	}
 #endif
 }
 
+/* Haiku extension: reads back only count rectangles given as x, y, width,
+ * height quadruples in user buffer coordinates, the rest of the buffer
+ * keeps what the previous swaps put there. Pipelined readback is bypassed.
+ */
+GLAPI void GLAPIENTRY
+OSMesaSwapBuffersRects(OSMesaContext ctx, const GLint *rects, GLsizei count) {
+#ifdef __cplusplus
+	if (!ctx || !rects || count <= 0) return;
+	
+	OSMesaContextRec* context = ValidContext(ctx);
+	if (!context) return;
+	
+	if (!context->userBuffer || context->width <= 0 || context->height <= 0) {
+		return;
+	}
+	
+	if (g_currentContext != context || !context->contextLocked || !context->glView) {
+		return;
+	}
+	
+	glReadBuffer(GL_FRONT);
+	const GLint rowLength = RowLength(context);
+	glPixelStorei(GL_PACK_ROW_LENGTH, rowLength);
+	
+	const GLboolean invert = context->yUp && HasPackInvert(context);
+	if (invert)
+		glPixelStorei(GL_PACK_INVERT_MESA, GL_TRUE);
+	
+	unsigned char* pixels = (unsigned char*)context->userBuffer;
+	for (GLsizei i = 0; i < count; i++) {
+		GLint x = std::max(rects[i * 4], 0);
+		GLint y = std::max(rects[i * 4 + 1], 0);
+		GLint w = std::min(rects[i * 4] + rects[i * 4 + 2], (GLint)context->width) - x;
+		GLint h = std::min(rects[i * 4 + 1] + rects[i * 4 + 3], (GLint)context->height) - y;
+		if (w <= 0 || h <= 0)
+			continue;
+		
+		unsigned char* target = pixels + ((size_t)y * rowLength + x) * 4;
+		if (!context->yUp) {
+			glReadPixels(x, y, w, h, GL_BGRA, GL_UNSIGNED_BYTE, target);
+		} else if (invert) {
+			glReadPixels(x, context->height - y - h, w, h, GL_BGRA, GL_UNSIGNED_BYTE, target);
+		} else {
+			for (GLint row = 0; row < h; row++) {
+				glReadPixels(x, context->height - y - 1 - row, w, 1, GL_BGRA, GL_UNSIGNED_BYTE,
+					target + (size_t)row * rowLength * 4);
+			}
+		}
+	}
+	
+	if (invert)
+		glPixelStorei(GL_PACK_INVERT_MESA, GL_FALSE);
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+#endif
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,12 +22,18 @@ SOURCES =   main.cpp \
 			qhaikubackingstore.cpp \
 			qhaikuclipboard.cpp \
 			qhaikucursor.cpp \
+			qhaikueventring.cpp \
+			qhaikuframestats.cpp \
+			qhaikuglbufferpool.cpp \
 			qhaikuglcontext.cpp \
+			qhaikuglpolicy.cpp \
 			qhaikuintegration.cpp \
+			qhaikukeymap.cpp \
 			qhaikunativeinterface.cpp \
 			qhaikuoffscreensurface.cpp \
 			qhaikuplatformdialoghelpers.cpp \
 			qhaikuplatformfontdatabase.cpp \
+			qhaikupresenter.cpp \
 			qhaikuscreen.cpp \
 			qhaikuservices.cpp \
 			qhaikusystemlocale.cpp \
@@ -41,12 +47,18 @@ HEADERS =	qhaikuapplication.h \
 			qhaikubackingstore.h \
 			qhaikuclipboard.h \
 			qhaikucursor.h \
+			qhaikueventring.h \
+			qhaikuframestats.h \
+			qhaikuglbufferpool.h \
 			qhaikuglcontext.h \
+			qhaikuglpolicy.h \
 			qhaikuintegration.h \
+			qhaikukeymap.h \
 			qhaikunativeinterface.h \
 			qhaikuoffscreensurface.h \
 			qhaikuplatformdialoghelpers.h \
 			qhaikuplatformfontdatabase.h \
+			qhaikupresenter.h \
 			qhaikuscreen.h \
 			qhaikuservices.h \
 			qhaikusystemlocale.h \
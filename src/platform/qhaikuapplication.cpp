@@ -40,6 +40,7 @@
 
 #include "qhaikuintegration.h"
 #include "qhaikuapplication.h"
+#include "qhaikukeymap.h"
 #include "qhaikusettings.h"
 
 
@@ -89,6 +90,9 @@ void HQApplication::MessageReceived(BMessage* message)
 				fClipboard->clipboardChanged();
 			break;
 			}
+		case B_KEY_MAP_LOADED:
+			QHaikuKeyMapper::invalidate();
+			break;
 		default:
 			BApplication::MessageReceived(message);
 			break;
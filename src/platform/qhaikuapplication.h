@@ -76,6 +76,7 @@
 #define Q_REF_TO_ARGV 	0x01
 #define Q_REF_TO_FORK 	0x02
 #define Q_KILL_ON_EXIT	0x04
+#define Q_GL_ASYNC_READBACK	0x08
 
 class HQApplication : public QObject, public BApplication
 {
@@ -42,6 +42,7 @@
 #include "qhaikuwindow.h"
 #include "qhaikucursor.h"
 #include "qhaikuintegration.h"
+#include "qhaikusettings.h"
 
 #include <QtGui/private/qpixmap_raster_p.h>
 #include <QtGui/private/qguiapplication_p.h>
@@ -49,23 +50,586 @@
 #include <qpa/qplatformcursor.h>
 #include <qpa/qplatformwindow.h>
 
+#include <qapplication.h>
+#include <qpaintdevicewindow.h>
+
 #include <qdebug.h>
+#include <qdeadlinetimer.h>
+#include <qloggingcategory.h>
 
 QT_BEGIN_NAMESPACE
 
+Q_LOGGING_CATEGORY(lcQpaBackingStore, "qt.qpa.backingstore", QtWarningMsg);
+
+// Fixed cost of one DrawBitmapAsync() call, expressed in pixels. Used to
+// decide whether a region is cheaper to flush rect by rect or merged.
+static const qint64 kFlushBlitOverhead = 64 * 64;
+static const int kFlushMaxRects = 32;
+
+// How long to wait for app_server to release a buffer before painting
+// into it anyway.
+static const bigtime_t kFlushFenceTimeout = 100000;
+
+// Tiles that were not flushed for this long are given back.
+static const bigtime_t kTileIdleTime = 3000000;
+
+struct QHaikuBackingStoreConfig
+{
+	QHaikuBackingStore::FlushMode flushMode;
+	int bufferCount;
+	int poolStep;
+	int trimDelay;
+	bool serverScroll;
+	bool tiled;
+	int tileSize;
+	int releaseDelay;
+};
+
+static QHaikuBackingStoreConfig readBackingStoreConfig()
+{
+	QHaikuBackingStoreConfig config;
+
+	QSettings settings(QT_SETTINGS_FILENAME, QSettings::NativeFormat);
+	settings.beginGroup("QPA");
+	QString mode = settings.value("flush_mode", QString("adaptive")).toString();
+	config.bufferCount = qBound(1, settings.value("flush_buffers", 2).toInt(), 3);
+	config.poolStep = qMax(1, settings.value("backingstore_pool_step", 64).toInt());
+	config.trimDelay = qMax(0, settings.value("backingstore_trim_delay", 1000).toInt());
+	config.serverScroll = settings.value("server_scroll", true).toBool();
+	config.tiled = settings.value("tiled_backingstore", false).toBool();
+	config.tileSize = qBound(64, settings.value("tile_size", 256).toInt(), 1024);
+	config.releaseDelay = settings.value("backingstore_release_delay", 30).toInt();
+	settings.endGroup();
+
+	if (mode == QLatin1String("bounding"))
+		config.flushMode = QHaikuBackingStore::FlushBoundingRect;
+	else if (mode == QLatin1String("rects"))
+		config.flushMode = QHaikuBackingStore::FlushPerRect;
+	else
+		config.flushMode = QHaikuBackingStore::FlushAdaptive;
+
+	return config;
+}
+
+
+static const QHaikuBackingStoreConfig &backingStoreConfig()
+{
+	static const QHaikuBackingStoreConfig config = readBackingStoreConfig();
+	return config;
+}
+
+
+static inline quint64 rectBytes(const QRect &rect)
+{
+	return quint64(rect.width()) * quint64(rect.height()) * 4;
+}
+
+
+static inline int roundUpToStep(int value, int step)
+{
+	return ((qMax(value, 1) + step - 1) / step) * step;
+}
+
+
+static inline quint32 tileKey(int x, int y)
+{
+	return (quint32(y) << 16) | quint32(x);
+}
+
+
+// Copies the rects of region from source to target, target pixels are
+// addressed relative to origin.
+static void copyPixels(const uchar *sourceBits, int sourceBpr,
+	uchar *targetBits, int targetBpr, const QRegion &region, const QPoint &origin = QPoint())
+{
+	for (const QRect &rect : region) {
+		const int lineBytes = rect.width() * 4;
+		for (int y = rect.top(); y <= rect.bottom(); ++y) {
+			memcpy(targetBits + (y - origin.y()) * targetBpr + (rect.left() - origin.x()) * 4,
+				sourceBits + y * sourceBpr + rect.left() * 4, lineBytes);
+		}
+	}
+}
+
+
+// Qt assumes the backing store kept its pixels, so after they were released
+// the window has to be repainted as a whole.
+static void invalidateWindow(QWindow *window)
+{
+	if (qobject_cast<QApplication*>(QCoreApplication::instance()) != NULL) {
+		const QWidgetList widgets = QApplication::topLevelWidgets();
+		for (QWidget *widget : widgets) {
+			if (widget->windowHandle() == window) {
+				widget->update();
+				return;
+			}
+		}
+	}
+
+	if (QPaintDeviceWindow *paintDeviceWindow = qobject_cast<QPaintDeviceWindow*>(window))
+		paintDeviceWindow->update();
+}
+
+
+QHaikuFlushFence::QHaikuFlushFence()
+	: m_issued(0)
+	, m_completed(0)
+{
+}
+
+
+quint64 QHaikuFlushFence::insert()
+{
+	QMutexLocker locker(&m_mutex);
+	return ++m_issued;
+}
+
+
+quint64 QHaikuFlushFence::issued() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_issued;
+}
+
+
+void QHaikuFlushFence::signal(quint64 serial)
+{
+	QMutexLocker locker(&m_mutex);
+	if (serial > m_completed) {
+		m_completed = serial;
+		m_condition.wakeAll();
+	}
+}
+
+
+bool QHaikuFlushFence::isSignaled(quint64 serial) const
+{
+	QMutexLocker locker(&m_mutex);
+	return serial <= m_completed;
+}
+
+
+bool QHaikuFlushFence::wait(quint64 serial, bigtime_t timeout)
+{
+	QMutexLocker locker(&m_mutex);
+	QDeadlineTimer deadline(timeout / 1000);
+	while (serial > m_completed) {
+		if (!m_condition.wait(&m_mutex, deadline))
+			return serial <= m_completed;
+	}
+	return true;
+}
+
+
 QHaikuBackingStore::QHaikuBackingStore(QWindow *window)
     : QPlatformBackingStore(window)
+    , m_current(0)
+    , m_presented(false)
+    , m_allocations(0)
+    , m_lastTileSweep(0)
+    , m_haikuWindow(NULL)
+    , m_flushCount(0)
+    , m_flushedBytes(0)
+    , m_boundingBytes(0)
 {
-	BRect rect(0, 0, window->width() - 1, window->height() - 1);
-	m_bitmap = new BBitmap(rect, B_RGB32);	
-	m_image = QImage((uchar*)m_bitmap->Bits(), window->width(), window->height(), m_bitmap->BytesPerRow(), QImage::Format_RGB32);
+	m_flushMode = backingStoreConfig().flushMode;
+	m_serverScroll = backingStoreConfig().serverScroll;
+	m_tiled = backingStoreConfig().tiled;
+
+	m_trimTimer.setSingleShot(true);
+	m_trimTimer.setInterval(backingStoreConfig().trimDelay);
+	QObject::connect(&m_trimTimer, &QTimer::timeout, [this]() { trimBuffers(); });
+
+	m_releaseTimer.setSingleShot(true);
+	m_releaseTimer.setInterval(qMax(0, backingStoreConfig().releaseDelay) * 1000);
+	QObject::connect(&m_releaseTimer, &QTimer::timeout, [this]() { releaseBuffers(); });
+	attachToWindow();
+
+	createBuffers(capacityFor(window->size()));
+	updateImage(window->size());
+	m_unflushed = QRect(QPoint(), window->size());
 }
 
 
 QHaikuBackingStore::~QHaikuBackingStore()
 {
+	if (m_flushCount > 0) {
+		qCDebug(lcQpaBackingStore) << "Flushed" << m_flushedBytes << "bytes in" << m_flushCount
+			<< "flushes, bounding-box flushing would have sent" << m_boundingBytes << "bytes";
+	}
+	qCDebug(lcQpaBackingStore) << "Allocated" << m_allocations << "bitmaps";
+
+	if (m_haikuWindow != NULL)
+		m_haikuWindow->setBackingStore(NULL);
+
+	waitForBuffers();
+
+	QPlatformWindow *handle = window()->handle();
+	QHaikuSurfaceView *view = handle != NULL ? QHaikuWindow::viewForWinId(handle->winId()) : NULL;
+	if (view != NULL && view->LockLooper()) {
+		view->setFrontBuffer(NULL, QRegion());
+		view->UnlockLooper();
+	}
+
+	destroyBuffers();
+}
+
+
+QSize QHaikuBackingStore::capacityFor(const QSize &size) const
+{
+	const int step = backingStoreConfig().poolStep;
+	return QSize(roundUpToStep(size.width(), step), roundUpToStep(size.height(), step));
+}
+
+
+void QHaikuBackingStore::createBuffers(const QSize &capacity)
+{
+	m_capacity = capacity;
+	m_current = 0;
+	m_presented = false;
+
+	if (m_tiled) {
+		// Qt paints into plain memory, app_server only ever sees the tiles.
+		m_tiledImage = QImage(capacity, QImage::Format_RGB32);
+		m_allocations++;
+		return;
+	}
+
+	BRect rect(0, 0, capacity.width() - 1, capacity.height() - 1);
+
+	for (int i = 0; i < backingStoreConfig().bufferCount; ++i) {
+		Buffer buffer;
+		buffer.bitmap = new BBitmap(rect, B_RGB32);
+		buffer.serial = 0;
+		m_buffers.append(buffer);
+	}
+
+	m_allocations += m_buffers.size();
+}
+
+
+void QHaikuBackingStore::destroyBuffers()
+{
+	m_image = QImage();
+	for (int i = 0; i < m_buffers.size(); ++i)
+		delete m_buffers.at(i).bitmap;
+	m_buffers.clear();
+	m_tiledImage = QImage();
+	releaseTiles(QSize(), 0);
+	m_capacity = QSize();
+}
+
+
+quint64 QHaikuBackingStore::memoryUsage() const
+{
+	quint64 bytes = m_tiledImage.sizeInBytes();
+	for (int i = 0; i < m_buffers.size(); ++i)
+		bytes += m_buffers.at(i).bitmap->BitsLength();
+	for (QHash<quint32, Tile>::const_iterator it = m_tiles.constBegin(); it != m_tiles.constEnd(); ++it)
+		bytes += it->bitmap->BitsLength();
+	return bytes;
+}
+
+
+void QHaikuBackingStore::attachToWindow()
+{
+	if (m_haikuWindow != NULL || window()->handle() == NULL)
+		return;
+
+	m_haikuWindow = static_cast<QHaikuWindow*>(window()->handle());
+	m_haikuWindow->setBackingStore(this);
+}
+
+
+void QHaikuBackingStore::setWindowHidden(bool hidden)
+{
+	if (!hidden) {
+		m_releaseTimer.stop();
+		restoreBuffers();
+	} else if (backingStoreConfig().releaseDelay > 0 && m_capacity.isValid()) {
+		m_releaseTimer.start();
+	}
+}
+
+
+void QHaikuBackingStore::releaseBuffers()
+{
+	if (!m_capacity.isValid())
+		return;
+
+	waitForBuffers();
+
+	QHaikuSurfaceView *view = m_haikuWindow != NULL ? QHaikuWindow::viewForWinId(m_haikuWindow->winId()) : NULL;
+	if (view != NULL && view->LockLooperWithTimeout(10000) != B_OK) {
+		m_releaseTimer.start();
+		return;
+	}
+
+	const quint64 bytes = memoryUsage();
+	m_releasedSize = m_image.size();
+	m_trimTimer.stop();
+	if (view != NULL)
+		view->setFrontBuffer(NULL, QRegion());
+	destroyBuffers();
+	m_pendingScrolls.clear();
+	m_scrolledOnServer = QRegion();
+
+	if (view != NULL)
+		view->UnlockLooper();
+
+	qCDebug(lcQpaBackingStore) << "Released" << bytes << "bytes of hidden" << window();
+}
+
+
+bool QHaikuBackingStore::restoreBuffers()
+{
+	if (m_capacity.isValid())
+		return false;
+
+	createBuffers(capacityFor(m_releasedSize));
+	updateImage(m_releasedSize);
+	m_unflushed = QRect(QPoint(), m_releasedSize);
+	invalidateWindow(window());
+
+	qCDebug(lcQpaBackingStore) << "Restored" << memoryUsage() << "bytes of" << window();
+	return true;
+}
+
+
+uchar *QHaikuBackingStore::storageBits() const
+{
+	if (m_tiled)
+		return const_cast<uchar*>(m_tiledImage.constBits());
+	return (uchar*)currentBitmap()->Bits();
+}
+
+
+int QHaikuBackingStore::storageBytesPerRow() const
+{
+	if (m_tiled)
+		return m_tiledImage.bytesPerLine();
+	return currentBitmap()->BytesPerRow();
+}
+
+
+void QHaikuBackingStore::updateImage(const QSize &size)
+{
+	// The storage may be larger than the window, the image only looks at
+	// its top left corner.
+	m_image = QImage(storageBits(), size.width(), size.height(),
+		storageBytesPerRow(), QImage::Format_RGB32);
+}
+
+
+void QHaikuBackingStore::reallocateBuffers(const QSize &capacity, const QSize &size, const QRegion &preserved)
+{
+	// Called with the view looper locked, after waitForBuffers(). The view
+	// must not replay from a bitmap that is about to be deleted.
+	QHaikuSurfaceView *view = QHaikuWindow::viewForWinId(window()->winId());
+	if (view != NULL)
+		view->setFrontBuffer(NULL, QRegion());
+
+	QList<Buffer> oldBuffers = m_buffers;
+	QImage oldTiledImage = m_tiledImage;
+	const uchar *oldBits = m_capacity.isValid() ? storageBits() : NULL;
+	const int oldBpr = m_capacity.isValid() ? storageBytesPerRow() : 0;
+	const QRegion copied = preserved & QRect(QPoint(), m_image.size()) & QRect(QPoint(), size);
+
 	m_image = QImage();
-	delete m_bitmap;
+	m_buffers.clear();
+	createBuffers(capacity);
+
+	if (oldBits != NULL && !copied.isEmpty()) {
+		copyPixels(oldBits, oldBpr, storageBits(), storageBytesPerRow(), copied);
+		for (int i = 1; i < m_buffers.size(); ++i)
+			m_buffers[i].missing = copied;
+	}
+	updateImage(size);
+
+	for (int i = 0; i < oldBuffers.size(); ++i)
+		delete oldBuffers.at(i).bitmap;
+	releaseTiles(size, -1);
+
+	m_pendingScrolls.clear();
+	m_scrolledOnServer = QRegion();
+	m_unflushed = QRect(QPoint(), size);
+}
+
+
+void QHaikuBackingStore::trimBuffers()
+{
+	const QSize size = m_image.size();
+	const QSize capacity = capacityFor(size);
+
+	if (!m_capacity.isValid() || size.isEmpty() || capacity == m_capacity)
+		return;
+
+	waitForBuffers();
+
+	QHaikuSurfaceView *view = QHaikuWindow::viewForWinId(window()->winId());
+	if (view == NULL || view->LockLooperWithTimeout(10000) != B_OK) {
+		m_trimTimer.start();
+		return;
+	}
+
+	reallocateBuffers(capacity, size, QRect(QPoint(), size));
+	view->UnlockLooper();
+
+	qCDebug(lcQpaBackingStore) << "Trimmed bitmaps to" << capacity << "for" << size;
+}
+
+
+void QHaikuBackingStore::waitForFence(const QSharedPointer<QHaikuFlushFence> &fence, quint64 serial)
+{
+	if (fence.isNull() || fence->isSignaled(serial))
+		return;
+
+	const bigtime_t start = system_time();
+	if (!fence->wait(serial, kFlushFenceTimeout))
+		qCDebug(lcQpaBackingStore) << "Timed out waiting for app_server to release buffer" << serial;
+
+	if (QHaikuFrameStats *stats = frameStats())
+		stats->addSample(QHaikuFrameStats::PhaseWait, system_time() - start);
+}
+
+
+// Flushes hand bitmaps to app_server without waiting for it, none may be
+// deleted before its fence is signaled. The window thread signals them,
+// so this must run before the view looper is locked.
+void QHaikuBackingStore::waitForBuffers()
+{
+	for (int i = 0; i < m_buffers.size(); ++i)
+		waitForFence(m_buffers.at(i).fence, m_buffers.at(i).serial);
+	for (QHash<quint32, Tile>::const_iterator it = m_tiles.constBegin(); it != m_tiles.constEnd(); ++it)
+		waitForFence(it->fence, it->serial);
+}
+
+
+QHaikuFrameStats *QHaikuBackingStore::frameStats() const
+{
+	return m_haikuWindow != NULL ? m_haikuWindow->flushStats() : NULL;
+}
+
+
+void QHaikuBackingStore::prepareTiles(const QRegion &region)
+{
+	// Runs before the view is locked: waiting for a fence needs the window
+	// thread to get hold of the looper.
+	const int tileSize = backingStoreConfig().tileSize;
+	const QRect bounds = region.boundingRect();
+	const bigtime_t now = system_time();
+
+	m_dirtyTiles.clear();
+	if (region.isEmpty())
+		return;
+
+	for (int ty = bounds.top() / tileSize; ty <= bounds.bottom() / tileSize; ++ty) {
+		for (int tx = bounds.left() / tileSize; tx <= bounds.right() / tileSize; ++tx) {
+			const QRect tileRect(tx * tileSize, ty * tileSize, tileSize, tileSize);
+			const QRegion dirty = region & tileRect;
+			if (dirty.isEmpty())
+				continue;
+
+			const quint32 key = tileKey(tx, ty);
+			Tile &tile = m_tiles[key];
+			if (tile.bitmap == NULL) {
+				tile.bitmap = new BBitmap(BRect(0, 0, tileSize - 1, tileSize - 1), B_RGB32);
+				m_allocations++;
+			} else {
+				waitForFence(tile.fence, tile.serial);
+			}
+
+			tile.rects = flushRects(dirty);
+			tile.lastUsed = now;
+
+			QRegion copied;
+			for (const QRect &rect : tile.rects)
+				copied += rect;
+			copyPixels(m_image.constBits(), m_image.bytesPerLine(),
+				(uchar*)tile.bitmap->Bits(), tile.bitmap->BytesPerRow(), copied, tileRect.topLeft());
+			m_dirtyTiles.append(key);
+		}
+	}
+}
+
+
+quint64 QHaikuBackingStore::drawTiles(QHaikuSurfaceView *view, const QSharedPointer<QHaikuFlushFence> &fence, quint64 serial)
+{
+	const int tileSize = backingStoreConfig().tileSize;
+	quint64 bytes = 0;
+
+	for (int i = 0; i < m_dirtyTiles.size(); ++i) {
+		const quint32 key = m_dirtyTiles.at(i);
+		Tile &tile = m_tiles[key];
+		const QPoint origin((key & 0xffff) * tileSize, (key >> 16) * tileSize);
+
+		for (const QRect &rect : tile.rects) {
+			const QRect local = rect.translated(-origin);
+			view->DrawBitmapAsync(tile.bitmap,
+				BRect(local.left(), local.top(), local.right(), local.bottom()),
+				BRect(rect.left(), rect.top(), rect.right(), rect.bottom()));
+			bytes += rectBytes(rect);
+		}
+
+		tile.fence = fence;
+		tile.serial = serial;
+	}
+
+	m_dirtyTiles.clear();
+	return bytes;
+}
+
+
+void QHaikuBackingStore::releaseTiles(const QSize &size, bigtime_t idleTime)
+{
+	// Drops tiles outside of size, and tiles that were not flushed for
+	// idleTime. A negative idleTime keeps every tile inside size. Idle
+	// tiles still in use by app_server are kept, tiles outside of size
+	// wait for it, callers holding the view looper waitForBuffers() first.
+	const int tileSize = backingStoreConfig().tileSize;
+	const bigtime_t now = system_time();
+
+	QHash<quint32, Tile>::iterator it = m_tiles.begin();
+	while (it != m_tiles.end()) {
+		const QPoint origin((it.key() & 0xffff) * tileSize, (it.key() >> 16) * tileSize);
+		const bool outside = origin.x() >= size.width() || origin.y() >= size.height();
+		const bool idle = idleTime >= 0 && now - it->lastUsed >= idleTime
+			&& (it->fence.isNull() || it->fence->isSignaled(it->serial));
+		if (outside || idle) {
+			waitForFence(it->fence, it->serial);
+			delete it->bitmap;
+			it = m_tiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+
+void QHaikuBackingStore::advanceBuffer()
+{
+	if (m_buffers.size() < 2) {
+		waitForFence(m_buffers.at(m_current).fence, m_buffers.at(m_current).serial);
+		return;
+	}
+
+	const int previous = m_current;
+	m_current = (m_current + 1) % m_buffers.size();
+
+	Buffer &buffer = m_buffers[m_current];
+	waitForFence(buffer.fence, buffer.serial);
+
+	// Bring the new back buffer up to date with what was painted into
+	// the other buffers since it was last used.
+	if (!buffer.missing.isEmpty()) {
+		const BBitmap *source = m_buffers.at(previous).bitmap;
+		copyPixels((const uchar*)source->Bits(), source->BytesPerRow(),
+			(uchar*)buffer.bitmap->Bits(), buffer.bitmap->BytesPerRow(),
+			buffer.missing & QRect(QPoint(), m_image.size()));
+		buffer.missing = QRegion();
+	}
+
+	updateImage(m_image.size());
 }
 
 
@@ -75,23 +639,79 @@ QPaintDevice *QHaikuBackingStore::paintDevice()
 }
 
 
+void QHaikuBackingStore::beginPaint(const QRegion &region)
+{
+	restoreBuffers();
+
+	if (m_presented) {
+		m_presented = false;
+		advanceBuffer();
+	}
+
+	for (int i = 0; i < m_buffers.size(); ++i) {
+		if (i != m_current)
+			m_buffers[i].missing += region;
+	}
+
+	m_unflushed += region;
+	m_scrolledOnServer -= region;
+}
+
+
 void QHaikuBackingStore::drawChildWindows(QWindow *topwin)
 {
 	QHaikuWindow *topHaikuWin = QHaikuWindow::windowForWinId(topwin->winId());
 
 	for (int i = 0; i < topHaikuWin->fakeChildList()->size(); ++i) {
 		QHaikuWindow *win = topHaikuWin->fakeChildList()->at(i);
-		if (!win->window()->isTopLevel() && win->window()->isVisible()) {
+		if (!win->window()->isTopLevel() && win->window()->isVisible() && win->openGLBitmap() != NULL) {
 			QHaikuSurfaceView *view = QHaikuWindow::viewForWinId(topwin->winId());
 			QPoint origin = win->mapToGlobal(QPoint()) - topwin->mapToGlobal(QPoint());
-			view->DrawBitmapAsync(win->openGLBitmap(), BPoint(origin.x(), origin.y()));
+			QSize size = win->openGLBitmapSize();
+			view->DrawBitmapAsync(win->openGLBitmap(), BRect(0, 0, size.width() - 1, size.height() - 1),
+				BRect(origin.x(), origin.y(), origin.x() + size.width() - 1, origin.y() + size.height() - 1));
 		}
 	}
 }
 
 
+QList<QRect> QHaikuBackingStore::flushRects(const QRegion &region) const
+{
+	const QRect bounds = region.boundingRect();
+	const int count = region.rectCount();
+
+	if (m_flushMode == FlushBoundingRect || count <= 1)
+		return QList<QRect>() << bounds;
+
+	if (m_flushMode == FlushPerRect)
+		return QList<QRect>(region.begin(), region.end());
+
+	if (count > kFlushMaxRects)
+		return QList<QRect>() << bounds;
+
+	qint64 area = 0;
+	for (const QRect &rect : region)
+		area += qint64(rect.width()) * rect.height();
+
+	const qint64 mergedCost = qint64(bounds.width()) * bounds.height() + kFlushBlitOverhead;
+	const qint64 rectsCost = area + count * kFlushBlitOverhead;
+
+	if (mergedCost <= rectsCost)
+		return QList<QRect>() << bounds;
+
+	return QList<QRect>(region.begin(), region.end());
+}
+
+
 void QHaikuBackingStore::flush(QWindow *window, const QRegion &region, const QPoint &offset)
 {
+    attachToWindow();
+
+    // Nothing worth showing until the repaint asked for by restoreBuffers()
+    // comes in.
+    if (restoreBuffers())
+        return;
+
     if (m_image.size().isEmpty())// && !window->isTopLevel())
         return;
 
@@ -106,45 +726,176 @@ void QHaikuBackingStore::flush(QWindow *window, const QRegion &region, const QPo
         return;
 
     WId id = window->winId();
+	QHaikuWindow *haikuWindow = QHaikuWindow::windowForWinId(id);
 	QHaikuSurfaceView *view = QHaikuWindow::viewForWinId(id);
 
-    QRect outline = region.boundingRect();
+    QRegion damage = region & QRect(QPoint(), imageSize);
+    if (damage.isEmpty() && m_pendingScrolls.isEmpty())
+        return;
+
+    QHaikuFrameStats *stats = haikuWindow->flushStats();
+    const bigtime_t flushStart = system_time();
 
-	if (view->LockLooperWithTimeout(10000) == B_OK) {
+    // Whatever app_server can produce by replaying the pending scrolls
+    // does not need to be sent again.
+    const QRegion blitted = damage - m_scrolledOnServer;
+    QList<QRect> rects;
+    if (m_tiled)
+        prepareTiles(blitted);
+    else if (!blitted.isEmpty())
+        rects = flushRects(blitted);
+
+    bigtime_t phaseStart = system_time();
+    stats->addSample(QHaikuFrameStats::PhasePrepare, phaseStart - flushStart);
+
+	status_t locked = view->LockLooperWithTimeout(10000);
+	stats->addSample(QHaikuFrameStats::PhaseLock, system_time() - phaseStart);
+	phaseStart = system_time();
+
+	if (locked == B_OK) {
 		view->SetDrawingMode(B_OP_COPY);
 
-		QHaikuWindow *topHaikuWin = QHaikuWindow::windowForWinId(id)->topLevelWindow();
+		QHaikuWindow *topHaikuWin = haikuWindow->topLevelWindow();
 
-		BRect rect(outline.left(), outline.top(), outline.right(), outline.bottom());
-		BRegion winregion(rect);
+		BRegion winregion;
 		BRegion region = topHaikuWin->getClippingRegion();
 		view->ConstrainClippingRegion(&region);
-		view->DrawBitmapAsync(m_bitmap, rect, rect);
+
+		for (int i = 0; i < m_pendingScrolls.size(); ++i) {
+			const ScrollOp &op = m_pendingScrolls.at(i);
+			const QRect source = op.target.translated(-op.delta);
+			view->CopyBits(BRect(source.left(), source.top(), source.right(), source.bottom()),
+				BRect(op.target.left(), op.target.top(), op.target.right(), op.target.bottom()));
+		}
+
+		QSharedPointer<QHaikuFlushFence> fence = haikuWindow->flushFence();
+		const quint64 serial = fence.isNull() ? 0 : fence->insert();
+
+		quint64 bytes = 0;
+		if (m_tiled) {
+			bytes = drawTiles(view, fence, serial);
+			for (const QRect &outline : blitted)
+				winregion.Include(BRect(outline.left(), outline.top(), outline.right(), outline.bottom()));
+		} else {
+			for (const QRect &outline : rects) {
+				BRect rect(outline.left(), outline.top(), outline.right(), outline.bottom());
+				view->DrawBitmapAsync(currentBitmap(), rect, rect);
+				winregion.Include(rect);
+				bytes += rectBytes(outline);
+			}
+		}
+
 		winregion.Exclude(&region);
 		view->ConstrainClippingRegion(&winregion);
 		drawChildWindows(window);
-		view->Sync();
+		publishFrontBuffer(view, topHaikuWin);
+
+		stats->addSample(QHaikuFrameStats::PhaseDraw, system_time() - phaseStart);
+		phaseStart = system_time();
+
+		// Hand the commands to app_server without waiting for them. The
+		// window thread signals the fence once they have been consumed,
+		// and the buffer is not painted into again before that.
+		view->Flush();
+		if (!fence.isNull()) {
+			BMessage message(kFlushFence);
+			message.AddInt64("serial", serial);
+			view->Window()->PostMessage(&message);
+		}
     	view->UnlockLooper();
+
+		stats->addSample(QHaikuFrameStats::PhaseSync, system_time() - phaseStart);
+		stats->addSample(QHaikuFrameStats::PhaseTotal, system_time() - flushStart);
+		stats->addFrame(bytes);
+
+		if (!m_tiled) {
+			Buffer &buffer = m_buffers[m_current];
+			buffer.fence = fence;
+			buffer.serial = serial;
+			m_presented = true;
+		} else if (system_time() - m_lastTileSweep > kTileIdleTime) {
+			m_lastTileSweep = system_time();
+			releaseTiles(imageSize, kTileIdleTime);
+		}
+
+		m_pendingScrolls.clear();
+		m_scrolledOnServer = QRegion();
+		m_unflushed -= damage;
+
+		m_flushCount++;
+		m_flushedBytes += bytes;
+		m_boundingBytes += rectBytes(damage.boundingRect());
+		qCDebug(lcQpaBackingStore) << "Flushed" << bytes
+			<< "bytes of" << rectBytes(damage.boundingRect()) << "bounding";
     }
-    m_windowAreaHash[id] = bounds;
 }
 
 
-void QHaikuBackingStore::resize(const QSize &size, const QRegion &)
+void QHaikuBackingStore::resize(const QSize &size, const QRegion &staticContents)
 {
     WId id = window()->winId();
-    if (m_image.size() != size) {
+    if (m_image.size() == size)
+        return;
+
+	if (m_capacity.isValid()
+		&& size.width() <= m_capacity.width()
+		&& size.height() <= m_capacity.height()) {
+		// Still fits, keep the bitmaps and only look at less or more of
+		// them. The contents stay where they are, static or not.
+		m_unflushed += QRegion(QRect(QPoint(), size)) - QRect(QPoint(), m_image.size());
+		updateImage(size);
+	} else {
+		waitForBuffers();
 		QHaikuSurfaceView *view = QHaikuWindow::viewForWinId(id);
-		if (view->LockLooperWithTimeout(10000) == B_OK) {
-    		m_image = QImage();
-	        delete m_bitmap;
-
-			BRect rect(0, 0, size.width() - 1, size.height() - 1);
-			m_bitmap = new BBitmap(rect, B_RGB32, true);
-			m_image = QImage((uchar*)m_bitmap->Bits(), size.width(), size.height(), m_bitmap->BytesPerRow(), QImage::Format_RGB32);
-			view->UnlockLooper();
-    	}
-    }
+		if (view->LockLooperWithTimeout(10000) != B_OK)
+			return;
+		reallocateBuffers(capacityFor(size), size, staticContents);
+		view->UnlockLooper();
+	}
+
+	// Give memory back only once the size has settled.
+	if (capacityFor(size) != m_capacity)
+		m_trimTimer.start();
+	else
+		m_trimTimer.stop();
+}
+
+
+void QHaikuBackingStore::publishFrontBuffer(QHaikuSurfaceView *view, QHaikuWindow *topLevel)
+{
+	// Called with the view looper locked. With a single buffer Qt paints
+	// straight into the flushed bitmap, tiles only hold what was flushed
+	// last, and windows with GL children need those composited on top, so
+	// all of these go through a regular Qt expose.
+	if (view == NULL)
+		return;
+
+	if (m_tiled || m_buffers.size() < 2 || !topLevel->fakeChildList()->isEmpty()) {
+		view->setFrontBuffer(NULL, QRegion());
+		return;
+	}
+
+	view->setFrontBuffer(currentBitmap(), QRect(QPoint(), m_image.size()));
+}
+
+
+void QHaikuBackingStore::recordServerScroll(const QRect &rect, const QPoint &delta)
+{
+	const QRect target = rect.translated(delta) & rect & QRect(QPoint(), m_image.size());
+	if (target.isEmpty())
+		return;
+
+	const QRect source = target.translated(-delta);
+
+	// Pixels that app_server does not have yet move along with the scroll,
+	// everything else in the target is produced by CopyBits() at flush.
+	m_unflushed = (m_unflushed - target) + (m_unflushed & source).translated(delta);
+	m_scrolledOnServer = (m_scrolledOnServer - target) + (QRegion(target) - m_unflushed);
+
+	ScrollOp op;
+	op.target = target;
+	op.delta = delta;
+	m_pendingScrolls.append(op);
 }
 
 
@@ -153,8 +904,21 @@ bool QHaikuBackingStore::scroll(const QRegion &area, int dx, int dy)
 	if (m_image.isNull())
 		return false;
 
-	for (const QRect &rect : area)
+	if (m_presented) {
+		m_presented = false;
+		advanceBuffer();
+	}
+
+	for (const QRect &rect : area) {
 		qt_scrollRectInImage(m_image, rect, QPoint(dx, dy));
+		if (m_serverScroll)
+			recordServerScroll(rect, QPoint(dx, dy));
+	}
+
+	for (int i = 0; i < m_buffers.size(); ++i) {
+		if (i != m_current)
+			m_buffers[i].missing += area;
+	}
 
 	return true;
 }
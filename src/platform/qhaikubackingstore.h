@@ -53,16 +53,25 @@
 #include <qbitmap.h>
 #include <qpainter.h>
 #include <qhash.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+#include <qsharedpointer.h>
+#include <qtimer.h>
 
 #include <View.h>
 #include <Bitmap.h>
 #include <Rect.h>
 #include <Region.h>
 
+class QHaikuSurfaceView;
+
 extern void qt_scrollRectInImage(QImage &img, const QRect &rect, const QPoint &offset);
 
 QT_BEGIN_NAMESPACE
 
+class QHaikuWindow;
+class QHaikuFrameStats;
+
 class QHaikuDrag : public QPlatformDrag
 {
 public:
@@ -70,13 +79,38 @@ public:
     Qt::DropAction drag(QDrag *) override { return Qt::IgnoreAction; }
 };
 
+class QHaikuFlushFence
+{
+public:
+    QHaikuFlushFence();
+
+    quint64 insert();
+    quint64 issued() const;
+    void signal(quint64 serial);
+    bool isSignaled(quint64 serial) const;
+    bool wait(quint64 serial, bigtime_t timeout);
+
+private:
+    mutable QMutex m_mutex;
+    QWaitCondition m_condition;
+    quint64 m_issued;
+    quint64 m_completed;
+};
+
 class QHaikuBackingStore : public QPlatformBackingStore
 {
 public:
+    enum FlushMode {
+        FlushAdaptive,
+        FlushBoundingRect,
+        FlushPerRect
+    };
+
     QHaikuBackingStore(QWindow *window);
     ~QHaikuBackingStore();
 
     QPaintDevice *paintDevice() override;
+    void beginPaint(const QRegion &region) override;
     void flush(QWindow *window, const QRegion &region, const QPoint &offset) override;
     void resize(const QSize &size, const QRegion &staticContents) override;
     bool scroll(const QRegion &area, int dx, int dy) override;
@@ -84,13 +118,85 @@ public:
 
     void drawChildWindows(QWindow *topwin);
 
+    void setWindowHidden(bool hidden);
+    void windowDestroyed() { m_haikuWindow = NULL; }
+    quint64 memoryUsage() const;
+
 private:
-    void clearHash();
+    struct Buffer {
+        BBitmap *bitmap;
+        QRegion missing;
+        QSharedPointer<QHaikuFlushFence> fence;
+        quint64 serial;
+    };
+
+    struct ScrollOp {
+        QRect target;
+        QPoint delta;
+    };
+
+    struct Tile {
+        Tile() : bitmap(NULL), serial(0), lastUsed(0) { }
+
+        BBitmap *bitmap;
+        QSharedPointer<QHaikuFlushFence> fence;
+        quint64 serial;
+        bigtime_t lastUsed;
+        QList<QRect> rects;
+    };
+
+    QList<QRect> flushRects(const QRegion &region) const;
+
+    QSize capacityFor(const QSize &size) const;
+    void createBuffers(const QSize &capacity);
+    void destroyBuffers();
+    void updateImage(const QSize &size);
+    void reallocateBuffers(const QSize &capacity, const QSize &size, const QRegion &preserved);
+    void trimBuffers();
+    void advanceBuffer();
+    void waitForFence(const QSharedPointer<QHaikuFlushFence> &fence, quint64 serial);
+    void waitForBuffers();
+    QHaikuFrameStats *frameStats() const;
+    void prepareTiles(const QRegion &region);
+    quint64 drawTiles(QHaikuSurfaceView *view, const QSharedPointer<QHaikuFlushFence> &fence, quint64 serial);
+    void releaseTiles(const QSize &size, bigtime_t idleTime);
+    void recordServerScroll(const QRect &rect, const QPoint &delta);
+    void publishFrontBuffer(QHaikuSurfaceView *view, QHaikuWindow *topLevel);
+    void attachToWindow();
+    void releaseBuffers();
+    bool restoreBuffers();
+    BBitmap *currentBitmap() const { return m_buffers.at(m_current).bitmap; }
+    uchar *storageBits() const;
+    int storageBytesPerRow() const;
 
     QImage m_image;
-    BBitmap *m_bitmap;
-    
-    QHash<WId, QRect> m_windowAreaHash;
+    QList<Buffer> m_buffers;
+    QSize m_capacity;
+    int m_current;
+    bool m_presented;
+
+    QTimer m_trimTimer;
+    quint64 m_allocations;
+
+    bool m_tiled;
+    QImage m_tiledImage;
+    QHash<quint32, Tile> m_tiles;
+    QList<quint32> m_dirtyTiles;
+    bigtime_t m_lastTileSweep;
+
+    QHaikuWindow *m_haikuWindow;
+    QTimer m_releaseTimer;
+    QSize m_releasedSize;
+
+    bool m_serverScroll;
+    QList<ScrollOp> m_pendingScrolls;
+    QRegion m_unflushed;
+    QRegion m_scrolledOnServer;
+
+    FlushMode m_flushMode;
+    quint64 m_flushCount;
+    quint64 m_flushedBytes;
+    quint64 m_boundingBytes;
 };
 
 QT_END_NAMESPACE
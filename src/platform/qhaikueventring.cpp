@@ -0,0 +1,193 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qhaikueventring.h"
+
+#include <Message.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+QT_BEGIN_NAMESPACE
+
+bigtime_t QHaikuEvent::timestamp(const BMessage *message)
+{
+	bigtime_t when;
+	if (message == NULL || message->FindInt64("when", &when) != B_OK)
+		return system_time();
+	return when;
+}
+
+
+QHaikuEventRing::QHaikuEventRing()
+	: m_head(0)
+	, m_tail(0)
+	, m_wakeupPending(0)
+	, m_overflowing(0)
+{
+	if (pipe(m_pipe) != 0) {
+		m_pipe[0] = -1;
+		m_pipe[1] = -1;
+		return;
+	}
+	fcntl(m_pipe[0], F_SETFL, fcntl(m_pipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(m_pipe[1], F_SETFL, fcntl(m_pipe[1], F_GETFL) | O_NONBLOCK);
+	fcntl(m_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(m_pipe[1], F_SETFD, FD_CLOEXEC);
+}
+
+
+QHaikuEventRing::~QHaikuEventRing()
+{
+	if (isValid()) {
+		close(m_pipe[0]);
+		close(m_pipe[1]);
+	}
+}
+
+
+void QHaikuEventRing::push(const QHaikuEvent &event)
+{
+	if (m_overflowing.loadAcquire() == 0 && pushRing(event))
+		return;
+
+	// The consumer may have emptied the overflow list in the meantime,
+	// then the ring has room again.
+	{
+		QMutexLocker locker(&m_overflowMutex);
+		if (m_overflowing.loadRelaxed() != 0 || !pushRing(event)) {
+			m_overflow.append(event);
+			m_overflowing.storeRelease(1);
+		}
+	}
+	wakeup();
+}
+
+
+bool QHaikuEventRing::isBacklogged() const
+{
+	return m_overflowing.loadAcquire() != 0
+		|| m_head.loadRelaxed() - m_tail.loadAcquire() >= Capacity;
+}
+
+
+bool QHaikuEventRing::pushRing(const QHaikuEvent &event)
+{
+	const quint32 head = m_head.loadRelaxed();
+	if (head - m_tail.loadAcquire() >= Capacity)
+		return false;
+
+	m_events[head % Capacity] = event;
+	m_head.storeRelease(head + 1);
+	wakeup();
+	return true;
+}
+
+
+void QHaikuEventRing::wakeup()
+{
+	if (m_wakeupPending.fetchAndStoreOrdered(1) == 0 && isValid()) {
+		const char byte = 0;
+		ssize_t result = write(m_pipe[1], &byte, 1);
+		Q_UNUSED(result);
+	}
+}
+
+
+void QHaikuEventRing::acknowledge()
+{
+	char buffer[16];
+	while (isValid() && read(m_pipe[0], buffer, sizeof(buffer)) > 0)
+		;
+	// Anything pushed from here on wakes the consumer again.
+	m_wakeupPending.fetchAndStoreOrdered(0);
+}
+
+
+bool QHaikuEventRing::pop(QHaikuEvent *event)
+{
+	// Overflowed events come after the ring they overflowed, and before
+	// anything pushed into the ring once they were taken over.
+	if (!m_drained.isEmpty()) {
+		*event = m_drained.takeFirst();
+		return true;
+	}
+
+	const quint32 tail = m_tail.loadRelaxed();
+	if (tail != m_head.loadAcquire()) {
+		*event = m_events[tail % Capacity];
+		m_tail.storeRelease(tail + 1);
+		return true;
+	}
+
+	if (m_overflowing.loadAcquire() == 0)
+		return false;
+
+	{
+		QMutexLocker locker(&m_overflowMutex);
+		m_drained.swap(m_overflow);
+		m_overflowing.storeRelease(0);
+	}
+	if (m_drained.isEmpty())
+		return false;
+	*event = m_drained.takeFirst();
+	return true;
+}
+
+
+bool QHaikuEventRing::peek(int index, QHaikuEvent *event) const
+{
+	if (index < 0)
+		return false;
+	if (index < m_drained.size()) {
+		*event = m_drained.at(index);
+		return true;
+	}
+	index -= m_drained.size();
+
+	const quint32 tail = m_tail.loadRelaxed();
+	if (quint32(index) >= m_head.loadAcquire() - tail)
+		return false;
+
+	*event = m_events[(tail + index) % Capacity];
+	return true;
+}
+
+QT_END_NAMESPACE
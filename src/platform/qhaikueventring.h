@@ -0,0 +1,175 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QHAIKUEVENTRING_H
+#define QHAIKUEVENTRING_H
+
+#include <qglobal.h>
+#include <qatomic.h>
+#include <qlist.h>
+#include <qmutex.h>
+
+#include <SupportDefs.h>
+#include <OS.h>
+
+class BMessage;
+
+QT_BEGIN_NAMESPACE
+
+// Input and window state changes as posted by the BWindow thread. Plain
+// data only, so posting one does not allocate.
+struct QHaikuEvent
+{
+    enum Type {
+        Mouse,
+        Tablet,
+        Wheel,
+        Key,
+        Enter,
+        Leave,
+        Moved,
+        Resized,
+        Activated,
+        WorkspaceActivated,
+        Zoomed,
+        Minimized,
+        QuitRequested
+    };
+
+    struct MouseData {
+        int32 localX, localY;
+        int32 globalX, globalY;
+        uint32 buttons;         // Qt::MouseButtons
+        uint32 button;          // Qt::MouseButton
+        uint32 type;            // QEvent::Type
+        uint32 source;          // Qt::MouseEventSource
+    };
+
+    struct TabletData {
+        float localX, localY;
+        float globalX, globalY;
+        float pressure;
+        int32 device;
+        int32 pointerType;
+        uint32 buttons;
+    };
+
+    struct WheelData {
+        int32 localX, localY;
+        int32 globalX, globalY;
+        float deltaX, deltaY;   // Wheel steps, positive away from the user
+        bool fine;              // Fractional steps, a touchpad or smooth wheel
+    };
+
+    struct KeyData {
+        enum { MaxText = 23 };
+        uint32 type;            // QEvent::Type
+        int32 key;
+        uint8 textLength;
+        char text[MaxText];     // UTF-8, not terminated
+    };
+
+    struct StateData {
+        int32 x, y;             // Moved position or Resized size
+        int32 workspace;
+        bool active;            // Activated, WorkspaceActivated, Minimized
+    };
+
+    // The app_server timestamp of a message, or now if it has none.
+    static bigtime_t timestamp(const BMessage *message);
+
+    Type type;
+    uint32 modifiers;           // Qt::KeyboardModifiers
+    bigtime_t when;             // system_time() base
+    union {
+        MouseData mouse;
+        TabletData tablet;
+        WheelData wheel;
+        KeyData key;
+        StateData state;
+    };
+};
+
+// Single producer, single consumer ring of events from the BWindow thread
+// to the Qt thread. The first event after the consumer caught up writes a
+// byte to a pipe, the consumer watches its read end and drains everything
+// queued by then in one go. Events that do not fit while the Qt thread is
+// busy go to an overflow list, and everything after them as well until
+// the consumer emptied it, so nothing is lost or reordered.
+class QHaikuEventRing
+{
+public:
+    enum { Capacity = 512 };
+
+    QHaikuEventRing();
+    ~QHaikuEventRing();
+
+    bool isValid() const { return m_pipe[0] >= 0; }
+    int wakeupDescriptor() const { return m_pipe[0]; }
+
+    // Producer side. isBacklogged() tells whether push() would overflow.
+    void push(const QHaikuEvent &event);
+    bool isBacklogged() const;
+
+    // Consumer side, acknowledge() before draining with pop(). peek()
+    // looks at queued events after the next one without taking them.
+    void acknowledge();
+    bool pop(QHaikuEvent *event);
+    bool peek(int index, QHaikuEvent *event) const;
+
+private:
+    bool pushRing(const QHaikuEvent &event);
+    void wakeup();
+
+    QHaikuEvent m_events[Capacity];
+    QAtomicInteger<quint32> m_head;
+    QAtomicInteger<quint32> m_tail;
+    QAtomicInt m_wakeupPending;
+    int m_pipe[2];
+
+    QMutex m_overflowMutex;
+    QList<QHaikuEvent> m_overflow;
+    QAtomicInt m_overflowing;
+    QList<QHaikuEvent> m_drained;       // Consumer only
+};
+
+QT_END_NAMESPACE
+
+#endif // QHAIKUEVENTRING_H
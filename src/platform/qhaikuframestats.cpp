@@ -0,0 +1,224 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qhaikuframestats.h"
+
+#include <qdebug.h>
+#include <qwindow.h>
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+Q_LOGGING_CATEGORY(lcQpaHaikuPerf, "qt.qpa.haiku.perf", QtWarningMsg);
+
+static void addToHistogram(QHaikuFrameStats::Histogram &histogram, bigtime_t duration)
+{
+	duration = qMax(bigtime_t(0), duration);
+
+	int bucket = 0;
+	while (bucket < QHaikuFrameStats::HistogramBuckets - 1 && (bigtime_t(1) << bucket) <= duration)
+		bucket++;
+
+	histogram.samples++;
+	histogram.total += duration;
+	histogram.max = qMax(histogram.max, duration);
+	histogram.buckets[bucket]++;
+}
+
+
+static void dumpHistogram(const char *name, const QHaikuFrameStats::Histogram &histogram)
+{
+	if (histogram.samples == 0)
+		return;
+
+	QString buckets;
+	for (int i = 0; i < QHaikuFrameStats::HistogramBuckets; ++i) {
+		if (histogram.buckets[i] != 0)
+			buckets += QString(" <%1us:%2").arg(quint64(1) << i).arg(histogram.buckets[i]);
+	}
+
+	qCDebug(lcQpaHaikuPerf).nospace() << "  " << name
+		<< ": avg " << histogram.total / bigtime_t(histogram.samples) << "us"
+		<< ", max " << histogram.max << "us," << qPrintable(buckets);
+}
+
+
+QHaikuFrameStats::QHaikuFrameStats()
+	: m_frames(0)
+	, m_bytes(0)
+{
+	memset(m_histograms, 0, sizeof(m_histograms));
+}
+
+
+void QHaikuFrameStats::addSample(Phase phase, bigtime_t duration)
+{
+	QMutexLocker locker(&m_mutex);
+	addToHistogram(m_histograms[phase], duration);
+}
+
+
+void QHaikuFrameStats::addFrame(quint64 bytes)
+{
+	QMutexLocker locker(&m_mutex);
+	m_frames++;
+	m_bytes += bytes;
+}
+
+
+QHaikuFrameStats::Histogram QHaikuFrameStats::histogram(Phase phase) const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_histograms[phase];
+}
+
+
+quint64 QHaikuFrameStats::frames() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_frames;
+}
+
+
+quint64 QHaikuFrameStats::bytes() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_bytes;
+}
+
+
+const char *QHaikuFrameStats::phaseName(Phase phase)
+{
+	switch (phase) {
+		case PhaseWait:
+			return "wait";
+		case PhasePrepare:
+			return "prepare";
+		case PhaseLock:
+			return "lock";
+		case PhaseDraw:
+			return "draw";
+		case PhaseSync:
+			return "sync";
+		case PhaseTotal:
+			return "total";
+		default:
+			return "unknown";
+	}
+}
+
+
+void QHaikuFrameStats::dump(const char *name, const QWindow *window) const
+{
+	if (!lcQpaHaikuPerf().isDebugEnabled())
+		return;
+
+	QMutexLocker locker(&m_mutex);
+	if (m_frames == 0)
+		return;
+
+	qCDebug(lcQpaHaikuPerf) << window << name << m_frames << "frames," << m_bytes << "bytes";
+
+	for (int phase = 0; phase < PhaseCount; ++phase)
+		dumpHistogram(phaseName(Phase(phase)), m_histograms[phase]);
+}
+
+
+QHaikuEventLatency::QHaikuEventLatency()
+{
+	memset(m_histograms, 0, sizeof(m_histograms));
+}
+
+
+void QHaikuEventLatency::addSample(EventClass eventClass, bigtime_t latency)
+{
+	QMutexLocker locker(&m_mutex);
+	addToHistogram(m_histograms[eventClass], latency);
+}
+
+
+QHaikuFrameStats::Histogram QHaikuEventLatency::histogram(EventClass eventClass) const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_histograms[eventClass];
+}
+
+
+const char *QHaikuEventLatency::className(EventClass eventClass)
+{
+	switch (eventClass) {
+		case ClassButton:
+			return "button";
+		case ClassMotion:
+			return "motion";
+		case ClassTablet:
+			return "tablet";
+		case ClassWheel:
+			return "wheel";
+		case ClassKey:
+			return "key";
+		case ClassWindow:
+			return "window";
+		default:
+			return "unknown";
+	}
+}
+
+
+void QHaikuEventLatency::dump(const QWindow *window) const
+{
+	if (!lcQpaHaikuPerf().isDebugEnabled())
+		return;
+
+	QMutexLocker locker(&m_mutex);
+	quint64 events = 0;
+	for (int i = 0; i < ClassCount; ++i)
+		events += m_histograms[i].samples;
+	if (events == 0)
+		return;
+
+	qCDebug(lcQpaHaikuPerf) << window << "event latency," << events << "events";
+
+	for (int i = 0; i < ClassCount; ++i)
+		dumpHistogram(className(EventClass(i)), m_histograms[i]);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,134 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QHAIKUFRAMESTATS_H
+#define QHAIKUFRAMESTATS_H
+
+#include <qglobal.h>
+#include <qmutex.h>
+#include <qloggingcategory.h>
+
+#include <OS.h>
+
+QT_BEGIN_NAMESPACE
+
+Q_DECLARE_LOGGING_CATEGORY(lcQpaHaikuPerf)
+
+class QWindow;
+
+// Latency and transfer statistics of one presentation path of a window,
+// handed out by the native interface as "flushstats" and "swapstats".
+// Durations are in microseconds, histogram bucket n counts samples of
+// less than 2^n microseconds that did not fit into bucket n - 1.
+class QHaikuFrameStats
+{
+public:
+    enum Phase {
+        PhaseWait,      // back pressure: waiting for app_server to release a buffer
+        PhasePrepare,   // copying or reading back pixels before the view is locked
+        PhaseLock,      // LockLooperWithTimeout()
+        PhaseDraw,      // issuing CopyBits() and DrawBitmapAsync()
+        PhaseSync,      // Flush() or Sync()
+        PhaseTotal,
+        PhaseCount
+    };
+
+    enum { HistogramBuckets = 24 };
+
+    struct Histogram {
+        quint64 samples;
+        bigtime_t total;
+        bigtime_t max;
+        quint64 buckets[HistogramBuckets];
+    };
+
+    QHaikuFrameStats();
+
+    void addSample(Phase phase, bigtime_t duration);
+    void addFrame(quint64 bytes);
+
+    Histogram histogram(Phase phase) const;
+    quint64 frames() const;
+    quint64 bytes() const;
+
+    void dump(const char *name, const QWindow *window) const;
+
+    static const char *phaseName(Phase phase);
+
+private:
+    mutable QMutex m_mutex;
+    Histogram m_histograms[PhaseCount];
+    quint64 m_frames;
+    quint64 m_bytes;
+};
+
+// Time from the app_server timestamp of an input or window event to its
+// hand-off to QWindowSystemInterface, per event class. Handed out by the
+// native interface as "eventlatency", buckets as in QHaikuFrameStats.
+class QHaikuEventLatency
+{
+public:
+    enum EventClass {
+        ClassButton,
+        ClassMotion,
+        ClassTablet,
+        ClassWheel,
+        ClassKey,
+        ClassWindow,
+        ClassCount
+    };
+
+    QHaikuEventLatency();
+
+    void addSample(EventClass eventClass, bigtime_t latency);
+    QHaikuFrameStats::Histogram histogram(EventClass eventClass) const;
+
+    void dump(const QWindow *window) const;
+
+    static const char *className(EventClass eventClass);
+
+private:
+    mutable QMutex m_mutex;
+    QHaikuFrameStats::Histogram m_histograms[ClassCount];
+};
+
+QT_END_NAMESPACE
+
+#endif // QHAIKUFRAMESTATS_H
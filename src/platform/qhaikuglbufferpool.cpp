@@ -0,0 +1,202 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qhaikuglbufferpool.h"
+#include "qhaikuframestats.h"
+#include "qhaikusettings.h"
+
+#include <qdebug.h>
+#include <qsettings.h>
+
+#include <Bitmap.h>
+
+QT_BEGIN_NAMESPACE
+
+static const int kSizeClassStep = 64;
+static const bigtime_t kIdleTime = 10000000;
+
+QHaikuGLBufferPool::QHaikuGLBufferPool()
+	: m_pooledBytes(0)
+	, m_hits(0)
+	, m_misses(0)
+	, m_trimScheduled(false)
+{
+	QSettings settings(QT_SETTINGS_FILENAME, QSettings::NativeFormat);
+	settings.beginGroup("QPA");
+	int limit = qMax(0, settings.value("gl_buffer_pool_size", 64).toInt());
+	settings.endGroup();
+
+	m_limit = quint64(limit) * 1024 * 1024;
+
+	m_trimTimer.setSingleShot(true);
+	m_trimTimer.setInterval(int(kIdleTime / 1000));
+	QObject::connect(&m_trimTimer, &QTimer::timeout, [this]() { trimIdle(); });
+}
+
+
+QHaikuGLBufferPool::~QHaikuGLBufferPool()
+{
+	qCDebug(lcQpaHaikuPerf) << "GL buffer pool:" << m_hits << "hits" << m_misses << "misses"
+		<< m_pooledBytes / 1024 << "KiB pooled";
+
+	for (const Entry &entry : m_entries)
+		delete entry.bitmap;
+}
+
+
+QSize QHaikuGLBufferPool::sizeClass(const QSize &size)
+{
+	int width = qMax(1, size.width());
+	int height = qMax(1, size.height());
+	return QSize((width + kSizeClassStep - 1) / kSizeClassStep * kSizeClassStep,
+		(height + kSizeClassStep - 1) / kSizeClassStep * kSizeClassStep);
+}
+
+
+BBitmap *QHaikuGLBufferPool::acquire(const QSize &size)
+{
+	const QSize sizeClass = QHaikuGLBufferPool::sizeClass(size);
+
+	{
+		QMutexLocker locker(&m_mutex);
+		for (int i = m_entries.size() - 1; i >= 0; --i) {
+			BBitmap *bitmap = m_entries.at(i).bitmap;
+			if (bitmap->Bounds().IntegerWidth() + 1 == sizeClass.width()
+				&& bitmap->Bounds().IntegerHeight() + 1 == sizeClass.height()) {
+				m_entries.removeAt(i);
+				m_pooledBytes -= bitmap->BitsLength();
+				m_hits++;
+				return bitmap;
+			}
+		}
+		m_misses++;
+		trimLocked(system_time());
+	}
+
+	BBitmap *bitmap = new BBitmap(BRect(0, 0, sizeClass.width() - 1, sizeClass.height() - 1), B_RGB32);
+	if (bitmap->InitCheck() != B_OK) {
+		delete bitmap;
+		return NULL;
+	}
+	return bitmap;
+}
+
+
+void QHaikuGLBufferPool::release(BBitmap *bitmap)
+{
+	if (bitmap == NULL)
+		return;
+
+	QMutexLocker locker(&m_mutex);
+	Entry entry;
+	entry.bitmap = bitmap;
+	entry.released = system_time();
+	m_entries.append(entry);
+	m_pooledBytes += bitmap->BitsLength();
+	trimLocked(entry.released);
+
+	// Buffers are released on render threads, the timer lives on the GUI
+	// thread.
+	if (!m_trimScheduled && !m_entries.isEmpty()) {
+		m_trimScheduled = true;
+		QMetaObject::invokeMethod(&m_trimTimer, "start", Qt::QueuedConnection);
+	}
+}
+
+
+void QHaikuGLBufferPool::trim()
+{
+	QMutexLocker locker(&m_mutex);
+	trimLocked(system_time());
+}
+
+
+void QHaikuGLBufferPool::trimLocked(bigtime_t now)
+{
+	// Entries are kept in release order, the least recently used first.
+	while (!m_entries.isEmpty()) {
+		const Entry &entry = m_entries.first();
+		if (m_pooledBytes <= m_limit && now - entry.released < kIdleTime)
+			break;
+		m_pooledBytes -= entry.bitmap->BitsLength();
+		delete entry.bitmap;
+		m_entries.removeFirst();
+	}
+}
+
+
+void QHaikuGLBufferPool::trimIdle()
+{
+	QMutexLocker locker(&m_mutex);
+	const bigtime_t now = system_time();
+	trimLocked(now);
+
+	// Come back when the least recently used buffer turns idle.
+	if (m_entries.isEmpty()) {
+		m_trimScheduled = false;
+		m_trimTimer.setInterval(int(kIdleTime / 1000));
+		return;
+	}
+	const bigtime_t remaining = m_entries.first().released + kIdleTime - now;
+	m_trimTimer.start(int(qMax<bigtime_t>(remaining / 1000, 1)));
+}
+
+
+quint64 QHaikuGLBufferPool::hits() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_hits;
+}
+
+
+quint64 QHaikuGLBufferPool::misses() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_misses;
+}
+
+
+quint64 QHaikuGLBufferPool::pooledBytes() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_pooledBytes;
+}
+
+QT_END_NAMESPACE
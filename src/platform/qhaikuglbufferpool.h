@@ -0,0 +1,99 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QHAIKUGLBUFFERPOOL_H
+#define QHAIKUGLBUFFERPOOL_H
+
+#include <qlist.h>
+#include <qsize.h>
+#include <qmutex.h>
+#include <qtimer.h>
+
+#include <OS.h>
+
+class BBitmap;
+
+QT_BEGIN_NAMESPACE
+
+// Process wide pool of the color buffers Mesa renders GL windows and
+// offscreen surfaces into. Buffers are rounded up to size classes, so
+// resizing a window reuses the same bitmap until it leaves its class.
+// Released buffers are dropped least recently used first, once they
+// were idle for a while or the pool grows over gl_buffer_pool_size MB.
+// Idle buffers are also dropped by a timer on the GUI thread, for
+// applications that stopped rendering.
+class QHaikuGLBufferPool
+{
+public:
+    QHaikuGLBufferPool();
+    ~QHaikuGLBufferPool();
+
+    BBitmap *acquire(const QSize &size);
+    void release(BBitmap *bitmap);
+    void trim();
+
+    static QSize sizeClass(const QSize &size);
+
+    quint64 hits() const;
+    quint64 misses() const;
+    quint64 pooledBytes() const;
+
+private:
+    struct Entry {
+        BBitmap *bitmap;
+        bigtime_t released;
+    };
+
+    void trimLocked(bigtime_t now);
+    void trimIdle();
+
+    mutable QMutex m_mutex;
+    QList<Entry> m_entries;
+    quint64 m_pooledBytes;
+    quint64 m_limit;
+    quint64 m_hits;
+    quint64 m_misses;
+    QTimer m_trimTimer;
+    bool m_trimScheduled;
+};
+
+QT_END_NAMESPACE
+
+#endif // QHAIKUGLBUFFERPOOL_H
@@ -40,19 +40,32 @@
 
 #define OSMESA_BGL_IMPLEMENTATION
 #include "qhaikuglcontext.h"
+#include "qhaikuintegration.h"
+
+#include <QtGui/private/qguiapplication_p.h>
+
+#include <qvarlengtharray.h>
 
 QT_BEGIN_NAMESPACE
 
 Q_LOGGING_CATEGORY(lcQpaOpenGLContext, "qt.qpa.openglcontext", QtWarningMsg);
 
+// Damage made of more rects than this is read back as its bounding rect.
+static const int kMaxDamageRects = 16;
+
 QHaikuGLContext::QHaikuGLContext(QOpenGLContext *context)
 	: QPlatformOpenGLContext()
 	, m_mesaContext(NULL)
 	, m_shareContext(NULL)
+	, m_readbackBuffers(1)
+	, m_formatQueried(false)
 {
+	// Only what was asked for is allocated, unspecified depth and stencil
+	// sizes count as none, like EGL_DONT_CARE does elsewhere. Colors are
+	// always BGRA 8888, the only format OSMesa BGL reads back.
 	d_format = context->format();
-	d_format.setDepthBufferSize(24);
-	d_format.setStencilBufferSize(8);
+	d_format.setDepthBufferSize(qMax(0, d_format.depthBufferSize()));
+	d_format.setStencilBufferSize(qMax(0, d_format.stencilBufferSize()));
 	d_format.setRedBufferSize(8);
 	d_format.setGreenBufferSize(8);
 	d_format.setBlueBufferSize(8);
@@ -88,21 +101,44 @@ QHaikuGLContext::QHaikuGLContext(QOpenGLContext *context)
 		}
 	}
 
-	const int attribs[] = {
-		OSMESA_FORMAT, OSMESA_BGRA,
-		OSMESA_DEPTH_BITS, 24,
-		OSMESA_STENCIL_BITS, 8,
-		OSMESA_ACCUM_BITS, 0,
-		OSMESA_PROFILE, mesaProfile,
-		OSMESA_CONTEXT_MAJOR_VERSION, d_format.majorVersion(),
-		OSMESA_CONTEXT_MINOR_VERSION, d_format.minorVersion(),
-		0, 0
+	// Falls back upward, to the usual sizes and then to the full set.
+	const int requestedDepth = d_format.depthBufferSize();
+	const int requestedStencil = d_format.stencilBufferSize();
+	const int bufferConfigs[][2] = {
+		{ requestedDepth, requestedStencil },
+		{ requestedDepth > 0 ? qMax(requestedDepth, 24) : 0, requestedStencil > 0 ? 8 : 0 },
+		{ 24, 8 }
 	};
 
-	m_mesaContext = OSMesaCreateContextAttribs(attribs, m_shareContext);
+	for (int i = 0; i < 3 && m_mesaContext == NULL; ++i) {
+		const int depth = bufferConfigs[i][0];
+		const int stencil = bufferConfigs[i][1];
+		if (i > 0 && depth == bufferConfigs[i - 1][0] && stencil == bufferConfigs[i - 1][1])
+			continue;
+
+		const int attribs[] = {
+			OSMESA_FORMAT, OSMESA_BGRA,
+			OSMESA_DEPTH_BITS, depth,
+			OSMESA_STENCIL_BITS, stencil,
+			OSMESA_ACCUM_BITS, 0,
+			OSMESA_PROFILE, mesaProfile,
+			OSMESA_CONTEXT_MAJOR_VERSION, d_format.majorVersion(),
+			OSMESA_CONTEXT_MINOR_VERSION, d_format.minorVersion(),
+			0, 0
+		};
+
+		m_mesaContext = OSMesaCreateContextAttribs(attribs, m_shareContext);
+		if (m_mesaContext != NULL) {
+			d_format.setDepthBufferSize(depth);
+			d_format.setStencilBufferSize(stencil);
+		}
+	}
 
-	if (m_mesaContext == NULL)
+	if (m_mesaContext == NULL) {
 		m_mesaContext = OSMesaCreateContextExt(OSMESA_BGRA, 24, 8, 0, m_shareContext);
+		d_format.setDepthBufferSize(24);
+		d_format.setStencilBufferSize(8);
+	}
 
 	if (!m_mesaContext && m_shareContext) {
 		qCWarning(lcQpaOpenGLContext, "Could not create OSMesaContext with shared context, "
@@ -116,6 +152,9 @@ QHaikuGLContext::QHaikuGLContext(QOpenGLContext *context)
 		return;
 	}
 
+	QHaikuIntegration *integration = static_cast<QHaikuIntegration*>(QGuiApplicationPrivate::platformIntegration());
+	m_readbackBuffers = integration->glReadbackBuffers();
+
 	context->setFormat(d_format);
 
 	qCWarning(lcQpaOpenGLContext).verbosity(3) << "Created" << this << "based on requested" << context->format();
@@ -144,15 +183,22 @@ bool QHaikuGLContext::makeCurrent(QPlatformSurface *surface)
 	QSize size = surface->surface()->size();
 
 	void *pixelBuffer = NULL;
+	int rowLength = 0;
 
+	// Pooled buffers are rounded up to a size class, Mesa is told their
+	// real row length.
 	if (surfaceClass == QSurface::Window) {
 		QHaikuWindow *window = dynamic_cast<QHaikuWindow *>(surface);
-		if (window->makeCurrent())
+		if (window->makeCurrent()) {
 			pixelBuffer = window->openGLBuffer();
+			rowLength = window->openGLBitmap()->BytesPerRow() / 4;
+		}
 	} else {
 		QHaikuOffscreenSurface *offscreenSurface = dynamic_cast<QHaikuOffscreenSurface *>(surface);
-		if (offscreenSurface->isValid())
+		if (offscreenSurface->isValid()) {
 			pixelBuffer = offscreenSurface->openGLBuffer();
+			rowLength = offscreenSurface->openGLRowLength();
+		}
 	}
 
 	if (pixelBuffer == NULL)
@@ -161,10 +207,17 @@ bool QHaikuGLContext::makeCurrent(QPlatformSurface *surface)
 	if (!OSMesaMakeCurrent( m_mesaContext, pixelBuffer, GL_UNSIGNED_BYTE, size.width(), size.height()))
 		return false;
 
+	OSMesaPixelStore(OSMESA_ROW_LENGTH, rowLength);
 	OSMesaPixelStore(OSMESA_Y_UP, 1);
+	OSMesaPixelStore(OSMESA_READBACK_BUFFERS, m_readbackBuffers);
 
 	glViewport(0, 0, size.width(), size.height());
 
+	if (!m_formatQueried) {
+		m_formatQueried = true;
+		updateFormatFromDriver();
+	}
+
 	return true;
 }
 
@@ -186,40 +239,70 @@ void QHaikuGLContext::swapBuffers(QPlatformSurface *surface)
 	if (window == NULL)
 		return;
 
-	glFinish();
-
-	OSMesaSwapBuffers(m_mesaContext);
+	QHaikuFrameStats *stats = window->swapStats();
+	const bigtime_t swapStart = system_time();
+
+	// The bitmap is read back into below, app_server has to be done with
+	// the previous frame first.
+	QHaikuIntegration *integration = static_cast<QHaikuIntegration*>(QGuiApplicationPrivate::platformIntegration());
+	QHaikuPresenter *presenter = integration->presenter();
+	presenter->waitForPresent(window);
+
+	const bigtime_t readbackStart = system_time();
+	stats->addSample(QHaikuFrameStats::PhaseWait, readbackStart - swapStart);
+
+	// Pipelined readback waits on a fence for an older frame instead of
+	// draining the renderer.
+	if (m_readbackBuffers < 2)
+		glFinish();
+
+	// Reads back, already flipped, into the bitmap that is presented below.
+	// Frames with damage only touch those rects, as long as the bitmap
+	// holds the previous frame everywhere else.
+	const QRect surfaceRect(QPoint(), window->window()->size());
+	QRegion damage = window->takeOpenGLDamage() & surfaceRect;
+	if (damage.isEmpty() || m_readbackBuffers > 1 || !window->isOpenGLBitmapComplete())
+		damage = surfaceRect;
+
+	QList<QRect> rects;
+	if (damage.rectCount() > kMaxDamageRects)
+		rects << damage.boundingRect();
+	else
+		rects = QList<QRect>(damage.begin(), damage.end());
+
+	if (rects.size() == 1 && rects.first() == surfaceRect) {
+		OSMesaSwapBuffers(m_mesaContext);
+		window->setOpenGLBitmapComplete();
+	} else {
+		QVarLengthArray<GLint, kMaxDamageRects * 4> quads;
+		for (const QRect &rect : rects)
+			quads << rect.x() << rect.y() << rect.width() << rect.height();
+		OSMesaSwapBuffersRects(m_mesaContext, quads.constData(), rects.size());
+	}
 
-	QHaikuSurfaceView *view = QHaikuWindow::viewForWinId(window->window()->winId());
-	window->swapBuffers();
+	stats->addSample(QHaikuFrameStats::PhasePrepare, system_time() - readbackStart);
+
+	// Swap intervals are paced against the retrace by the frame clock of
+	// the screen, per window since a context may swap several of them.
+	// A frame that already missed its slot is shown at once instead of
+	// waiting for the next one, like adaptive vsync.
+	const int swapInterval = qMax(0, window->window()->format().swapInterval());
+	if (swapInterval > 0) {
+		QHaikuFrameClock *clock = integration->screen()->frameClock();
+		const quint64 lastFrame = window->lastSwapFrame();
+		if (lastFrame != 0 && clock->currentFrame() < lastFrame + swapInterval)
+			clock->waitUntilFrame(lastFrame + swapInterval);
+		window->setLastSwapFrame(clock->currentFrame());
+	}
 
 	if (window->openGLBitmap() != NULL) {
 		if (window->window()->isTopLevel()) {
-			if (view->LockLooperWithTimeout(10000) == B_OK) {
-				QHaikuWindow *topHaikuWin = QHaikuWindow::windowForWinId(window->topLevelWindow()->winId());
-
-				view->SetDrawingMode(B_OP_COPY);
-				BRegion region = topHaikuWin->getClippingRegion();
-				view->ConstrainClippingRegion(&region);
-				view->DrawBitmapAsync(window->openGLBitmap());
-				BRegion allregion(BRect(0, 0, window->window()->width(), window->window()->height()));
-				allregion.Exclude(&region);
-				view->ConstrainClippingRegion(&allregion);
-
-				for (int i = 0; i < topHaikuWin->fakeChildList()->size(); ++i) {
-					QHaikuWindow *win = topHaikuWin->fakeChildList()->at(i);
-					if (!win->window()->isTopLevel() && win->window()->isVisible()) {
-						QPoint origin = win->mapToGlobal(QPoint()) - topHaikuWin->mapToGlobal(QPoint());
-						view->DrawBitmapAsync(win->openGLBitmap(), BPoint(origin.x(), origin.y()));
-					}
-				}
-
-				view->Sync();
-				view->UnlockLooper();
-		    }
+			// The presenter locks the view and blits, this thread can go on
+			// rendering the next frame.
+			presenter->present(window, rects, window->window()->size());
+			stats->addSample(QHaikuFrameStats::PhaseTotal, system_time() - swapStart);
 		} else {
 			QHaikuWindow *topWindow = QHaikuWindow::windowForWinId(window->topLevelWindow()->winId());
-			view = QHaikuWindow::viewForWinId(window->topLevelWindow()->winId());
 
 			QPoint origin = window->window()->mapToGlobal(QPoint()) - topWindow->window()->mapToGlobal(QPoint());
 			QRect invalidateRect(origin.x(), origin.y(), window->window()->width(), window->window()->height());
@@ -229,6 +312,25 @@ void QHaikuGLContext::swapBuffers(QPlatformSurface *surface)
 }
 
 
+void QHaikuGLContext::updateFormatFromDriver()
+{
+	// BGL only knows whether there is a depth or stencil buffer, not how
+	// deep it is, so report what the driver actually handed out. Core
+	// profiles do not answer this query, they keep the requested sizes.
+	GLint depth = 0;
+	GLint stencil = 0;
+	glGetError();
+	glGetIntegerv(GL_DEPTH_BITS, &depth);
+	glGetIntegerv(GL_STENCIL_BITS, &stencil);
+	if (glGetError() != GL_NO_ERROR)
+		return;
+
+	d_format.setDepthBufferSize(depth);
+	d_format.setStencilBufferSize(stencil);
+	qCDebug(lcQpaOpenGLContext) << "Driver provided depth" << depth << "stencil" << stencil;
+}
+
+
 QSurfaceFormat QHaikuGLContext::format() const
 {
     return d_format;
@@ -94,7 +94,11 @@ public:
 	OSMesaContext m_shareContext;
    
 private:
+	void updateFormatFromDriver();
+
 	QSurfaceFormat d_format;
+	int m_readbackBuffers;
+	bool m_formatQueried;
 };
 
 Q_DECLARE_METATYPE(QHaikuNativeGLContext)
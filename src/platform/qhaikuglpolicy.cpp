@@ -0,0 +1,275 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qhaikuglpolicy.h"
+#include "qhaikuframestats.h"
+#include "qhaikusettings.h"
+#include "osmesa_bgl.h"
+
+#include <qdebug.h>
+#include <qimage.h>
+#include <qpainter.h>
+#include <qsettings.h>
+#include <qvector.h>
+
+#include <Application.h>
+#include <Path.h>
+#include <OS.h>
+
+#include <string.h>
+#include <sys/stat.h>
+
+QT_BEGIN_NAMESPACE
+
+// The probe frame: a full surface texture blit and a few blended fills,
+// roughly what a Quick or GL widget window composites per frame.
+static const int kProbeSize = 512;
+static const int kProbeFrames = 16;
+static const int kProbeFills = 32;
+
+static const char *kDefaultBlacklist[] = {
+	"application/x-vnd.telegram",		// performance issues
+	"application/x-vnd.kotatogram",		// performance issues
+};
+
+static QRect probeFill(int frame, int index)
+{
+	int x = (index * 37 + frame * 11) % (kProbeSize - 96);
+	int y = (index * 53 + frame * 7) % (kProbeSize - 64);
+	return QRect(x, y, 96, 64);
+}
+
+QHaikuGLPolicy::QHaikuGLPolicy()
+{
+	app_info appInfo;
+	if (be_app != NULL && be_app->GetAppInfo(&appInfo) == B_OK) {
+		m_signature = QLatin1String(appInfo.signature);
+		BPath path(&appInfo.ref);
+		if (path.InitCheck() == B_OK)
+			m_path = QString::fromUtf8(path.Path());
+	}
+}
+
+
+bool QHaikuGLPolicy::matches(const QStringList &list) const
+{
+	for (const QString &entry : list) {
+		if (!m_signature.isEmpty() && entry.compare(m_signature, Qt::CaseInsensitive) == 0)
+			return true;
+		if (!m_path.isEmpty() && entry == m_path)
+			return true;
+	}
+	return false;
+}
+
+
+bool QHaikuGLPolicy::useOpenGL()
+{
+	QStringList blacklist;
+	for (const char *signature : kDefaultBlacklist)
+		blacklist << QLatin1String(signature);
+
+	QSettings settings(QT_SETTINGS_FILENAME, QSettings::NativeFormat);
+	settings.beginGroup("QPA");
+	blacklist = settings.value("opengl_blacklist", blacklist).toStringList();
+	QStringList whitelist = settings.value("opengl_whitelist", QStringList()).toStringList();
+	bool enabled = settings.value("opengl_enabled", false).toBool();
+	bool autoSelect = settings.value("opengl_auto", true).toBool();
+	settings.endGroup();
+
+	if (matches(blacklist))
+		return false;
+	if (enabled || matches(whitelist))
+		return true;
+	if (!autoSelect || m_signature.isEmpty())
+		return true;
+
+	// QSettings keys are paths, signatures are stored with '/' replaced.
+	const QString key = QString(m_signature).replace(QLatin1Char('/'), QLatin1Char('_'));
+	const QString fingerprint = mesaFingerprint();
+
+	settings.beginGroup("OpenGLPolicy");
+	QStringList cached = settings.value(key).toStringList();
+	settings.endGroup();
+	if (cached.size() == 2 && cached.at(1) == fingerprint)
+		return cached.at(0) == QLatin1String("opengl");
+
+	bool openGL = probe();
+
+	settings.beginGroup("OpenGLPolicy");
+	settings.setValue(key, QStringList() << QLatin1String(openGL ? "opengl" : "raster") << fingerprint);
+	settings.endGroup();
+
+	return openGL;
+}
+
+
+bool QHaikuGLPolicy::probe()
+{
+	bigtime_t openGLTime = benchmarkOpenGL();
+	bigtime_t rasterTime = benchmarkRaster();
+
+	qCDebug(lcQpaHaikuPerf) << "GL policy probe for" << m_signature << "opengl"
+		<< openGLTime << "us raster" << rasterTime << "us";
+
+	return openGLTime >= 0 && openGLTime < rasterTime;
+}
+
+
+// Identifies the installed Mesa by the libGL this process loaded, a
+// package update replaces the file.
+QString QHaikuGLPolicy::mesaFingerprint()
+{
+	image_info info;
+	int32 cookie = 0;
+	while (get_next_image_info(B_CURRENT_TEAM, &cookie, &info) == B_OK) {
+		if (strstr(info.name, "libGL.so") == NULL)
+			continue;
+		struct stat st;
+		if (stat(info.name, &st) != 0)
+			break;
+		return QString::fromLatin1("%1:%2:%3").arg(QString::fromUtf8(info.name))
+			.arg(qint64(st.st_size)).arg(qint64(st.st_mtime));
+	}
+	return QLatin1String("unknown");
+}
+
+
+// Renders and reads back the probe frames through OSMesa, -1 if there
+// is no usable context.
+bigtime_t QHaikuGLPolicy::benchmarkOpenGL()
+{
+	OSMesaContext context = OSMesaCreateContextExt(OSMESA_BGRA, 0, 0, 0, NULL);
+	if (context == NULL)
+		return -1;
+
+	QVector<uint> pixels(kProbeSize * kProbeSize, 0xff808080);
+	if (!OSMesaMakeCurrent(context, pixels.data(), GL_UNSIGNED_BYTE, kProbeSize, kProbeSize)) {
+		OSMesaDestroyContext(context);
+		return -1;
+	}
+	OSMesaPixelStore(OSMESA_Y_UP, 1);
+
+	glViewport(0, 0, kProbeSize, kProbeSize);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0, kProbeSize, kProbeSize, 0, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kProbeSize, kProbeSize, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels.constData());
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	bigtime_t start = 0;
+	// The first frame compiles state and is not counted.
+	for (int frame = -1; frame < kProbeFrames; frame++) {
+		if (frame == 0)
+			start = system_time();
+
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		glEnable(GL_TEXTURE_2D);
+		glColor4f(1, 1, 1, 1);
+		glBegin(GL_QUADS);
+		glTexCoord2f(0, 0); glVertex2i(0, 0);
+		glTexCoord2f(1, 0); glVertex2i(kProbeSize, 0);
+		glTexCoord2f(1, 1); glVertex2i(kProbeSize, kProbeSize);
+		glTexCoord2f(0, 1); glVertex2i(0, kProbeSize);
+		glEnd();
+		glDisable(GL_TEXTURE_2D);
+
+		glEnable(GL_BLEND);
+		glBegin(GL_QUADS);
+		for (int i = 0; i < kProbeFills; i++) {
+			QRect fill = probeFill(frame, i);
+			glColor4f(0.25f, 0.25f, 0.5f, 0.5f);
+			glVertex2i(fill.left(), fill.top());
+			glVertex2i(fill.right() + 1, fill.top());
+			glVertex2i(fill.right() + 1, fill.bottom() + 1);
+			glVertex2i(fill.left(), fill.bottom() + 1);
+		}
+		glEnd();
+		glDisable(GL_BLEND);
+
+		OSMesaSwapBuffers(context);
+	}
+	bigtime_t elapsed = system_time() - start;
+
+	glDeleteTextures(1, &texture);
+	OSMesaMakeCurrent(NULL, NULL, GL_UNSIGNED_BYTE, 0, 0);
+	OSMesaDestroyContext(context);
+
+	return elapsed;
+}
+
+
+// Paints the same frames with the raster engine and copies them out the
+// way the backing store hands them to app_server.
+bigtime_t QHaikuGLPolicy::benchmarkRaster()
+{
+	QImage source(kProbeSize, kProbeSize, QImage::Format_RGB32);
+	source.fill(0xff808080);
+	QImage image(kProbeSize, kProbeSize, QImage::Format_ARGB32_Premultiplied);
+	QVector<uint> target(kProbeSize * kProbeSize);
+
+	bigtime_t start = 0;
+	for (int frame = -1; frame < kProbeFrames; frame++) {
+		if (frame == 0)
+			start = system_time();
+
+		QPainter painter(&image);
+		painter.setCompositionMode(QPainter::CompositionMode_Source);
+		painter.drawImage(0, 0, source);
+		painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+		for (int i = 0; i < kProbeFills; i++)
+			painter.fillRect(probeFill(frame, i), QColor(64, 64, 128, 128));
+		painter.end();
+
+		memcpy(target.data(), image.constBits(), image.sizeInBytes());
+	}
+	return system_time() - start;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,78 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QHAIKUGLPOLICY_H
+#define QHAIKUGLPOLICY_H
+
+#include <qstring.h>
+#include <qstringlist.h>
+
+#include <OS.h>
+
+QT_BEGIN_NAMESPACE
+
+// Decides whether an application gets OpenGL or stays on the raster
+// pipeline. In order of precedence:
+//  - opengl_blacklist: signatures or paths that always render raster
+//  - opengl_enabled: OpenGL for every other application
+//  - opengl_whitelist: signatures or paths that always get OpenGL
+//  - otherwise a short benchmark of both paths on first launch, cached
+//    per signature in the OpenGLPolicy group until Mesa changes
+class QHaikuGLPolicy
+{
+public:
+    QHaikuGLPolicy();
+
+    bool useOpenGL();
+
+private:
+    bool matches(const QStringList &list) const;
+    bool probe();
+    static QString mesaFingerprint();
+    static bigtime_t benchmarkOpenGL();
+    static bigtime_t benchmarkRaster();
+
+    QString m_signature;
+    QString m_path;
+};
+
+QT_END_NAMESPACE
+
+#endif // QHAIKUGLPOLICY_H
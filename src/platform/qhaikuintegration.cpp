@@ -53,6 +53,7 @@
 #include <qpa/qplatformopenglcontext.h>
 
 #include "qhaikuintegration.h"
+#include "qhaikuglpolicy.h"
 
 QT_BEGIN_INCLUDE_NAMESPACE
 extern char **environ;
@@ -74,7 +75,10 @@ QHaikuIntegration::QHaikuIntegration(const QStringList &parameters, int &argc, c
 	m_clipboard = new QHaikuClipboard();
 	m_haikuSystemLocale = new QHaikuSystemLocale;
 	m_drag = new QSimpleDrag();
-	m_openGlEnabled = isOpenGLEnabled();
+	m_openGlEnabled = -1;
+	m_glReadbackBuffers = readbackBufferCount();
+	m_presenter = new QHaikuPresenter();
+	m_glBufferPool = new QHaikuGLBufferPool();
 }
 
 QHaikuIntegration::~QHaikuIntegration()
@@ -85,6 +89,8 @@ QHaikuIntegration::~QHaikuIntegration()
 	delete m_clipboard;
 	delete m_drag;
 	delete m_services;
+	delete m_presenter;
+	delete m_glBufferPool;
 
 	QWindowSystemInterface::handleScreenRemoved(m_screen);
 
@@ -93,18 +99,27 @@ QHaikuIntegration::~QHaikuIntegration()
 		kill(::getpid(), SIGKILL);
 }
 
-bool QHaikuIntegration::isOpenGLEnabled()
+int QHaikuIntegration::readbackBufferCount()
 {
+	// Pipelined readback shows frames late, so applications opt in, either
+	// with Q_GL_ASYNC_READBACK in their QT:QPA_FLAGS resource or through
+	// the gl_async_readback list of signatures.
+	QSettings settings(QT_SETTINGS_FILENAME, QSettings::NativeFormat);
+	settings.beginGroup("QPA");
+	QStringList asyncApps = settings.value("gl_async_readback", QStringList()).toStringList();
+	int buffers = qBound(2, settings.value("gl_readback_buffers", 2).toInt(), 3);
+	settings.endGroup();
+
+	HQApplication *haikuApplication = static_cast<HQApplication*>(be_app);
+	if (haikuApplication->QtFlags() & Q_GL_ASYNC_READBACK)
+		return buffers;
+
 	app_info appInfo;
-	if (be_app->GetAppInfo(&appInfo) == B_OK) {
-		QStringList disabledListApps;
-		disabledListApps
-			<< "application/x-vnd.telegram" 		//performance issues
-			<< "application/x-vnd.kotatogram";		//performance issues
-		return !disabledListApps.contains(appInfo.signature, Qt::CaseInsensitive);
-	}
-	return true;
+	if (be_app->GetAppInfo(&appInfo) == B_OK
+		&& asyncApps.contains(QLatin1String(appInfo.signature), Qt::CaseInsensitive))
+		return buffers;
 
+	return 1;
 }
 
 QHaikuIntegration *QHaikuIntegration::createHaikuIntegration(const QStringList& parameters, int &argc, char **argv)
@@ -177,6 +192,8 @@ QHaikuIntegration *QHaikuIntegration::createHaikuIntegration(const QStringList&
 					qtFlags |= Q_REF_TO_FORK;
 				if (qtFlagsString.FindFirst("Q_KILL_ON_EXIT") != B_ERROR)
 					qtFlags |= Q_KILL_ON_EXIT;
+				if (qtFlagsString.FindFirst("Q_GL_ASYNC_READBACK") != B_ERROR)
+					qtFlags |= Q_GL_ASYNC_READBACK;
 			}
 		}
 		haikuApplication->SetQtFlags(qtFlags);		
@@ -295,16 +312,26 @@ bool QHaikuIntegration::hasCapability(QPlatformIntegration::Capability cap) cons
     case ThreadedPixmaps: return true;
     case MultipleWindows: return true;
 
-    case OpenGL: return m_openGlEnabled;
-    case ThreadedOpenGL: return m_openGlEnabled;
-    case RasterGLSurface: return m_openGlEnabled;
-    case OpenGLOnRasterSurface: return m_openGlEnabled;
-    case AllGLFunctionsQueryable: return m_openGlEnabled;
+    case OpenGL: return isOpenGLEnabled();
+    case ThreadedOpenGL: return isOpenGLEnabled();
+    case RasterGLSurface: return isOpenGLEnabled();
+    case OpenGLOnRasterSurface: return isOpenGLEnabled();
+    case AllGLFunctionsQueryable: return isOpenGLEnabled();
 
     default: return QPlatformIntegration::hasCapability(cap);
     }
 }
 
+// The policy may benchmark both pipelines, it is only asked once the
+// application wants OpenGL, not on every launch.
+bool QHaikuIntegration::isOpenGLEnabled() const
+{
+	QMutexLocker locker(&m_openGlMutex);
+	if (m_openGlEnabled < 0)
+		m_openGlEnabled = QHaikuGLPolicy().useOpenGL() ? 1 : 0;
+	return m_openGlEnabled != 0;
+}
+
 QPlatformWindow *QHaikuIntegration::createPlatformWindow(QWindow *window) const
 {
     QPlatformWindow *w = new QHaikuWindow(window);
@@ -331,7 +358,7 @@ QPlatformBackingStore *QHaikuIntegration::createPlatformBackingStore(QWindow *wi
 
 QPlatformOpenGLContext *QHaikuIntegration::createPlatformOpenGLContext(QOpenGLContext *context) const
 {
-	if (m_openGlEnabled)
+	if (isOpenGLEnabled())
 		return new QHaikuGLContext(context);
 	return nullptr;
 }
@@ -44,9 +44,12 @@
 #include <qpa/qplatformintegration.h>
 #include <qpa/qplatformopenglcontext.h>
 #include <qscopedpointer.h>
+#include <qmutex.h>
 
 #include "qhaikuapplication.h"
 #include "qhaikuwindow.h"
+#include "qhaikupresenter.h"
+#include "qhaikuglbufferpool.h"
 #include "qhaikubackingstore.h"
 #include "qhaikuglcontext.h"
 #include "qhaikuscreen.h"
@@ -84,6 +87,9 @@ public:
     QPlatformDrag *drag() const override;
     QPlatformServices *services() const override;
     QHaikuScreen *screen() { return m_screen; }
+    int glReadbackBuffers() const { return m_glReadbackBuffers; }
+    QHaikuPresenter *presenter() const { return m_presenter; }
+    QHaikuGLBufferPool *glBufferPool() const { return m_glBufferPool; }
 
     QPlatformFontDatabase *fontDatabase() const override;
     QAbstractEventDispatcher *createEventDispatcher() const override;
@@ -97,7 +103,8 @@ public:
 
 private:
     static int32 haikuApplicationThread(void *data);
-    static bool isOpenGLEnabled();
+    static int readbackBufferCount();
+    bool isOpenGLEnabled() const;
 
     QPlatformFontDatabase *m_fontDatabase;
     QHaikuNativeInterface *m_nativeInterface;
@@ -106,7 +113,11 @@ private:
     QHaikuSystemLocale *m_haikuSystemLocale;
     QHaikuScreen *m_screen;
     mutable QHaikuClipboard* m_clipboard;
-    bool m_openGlEnabled;
+    mutable QMutex m_openGlMutex;
+    mutable int m_openGlEnabled;    // -1 until the GL policy was asked
+    int m_glReadbackBuffers;
+    QHaikuPresenter *m_presenter;
+    QHaikuGLBufferPool *m_glBufferPool;
 private Q_SLOTS:
 	bool platformAppQuit();
 };
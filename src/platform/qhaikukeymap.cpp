@@ -0,0 +1,110 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qhaikukeymap.h"
+
+#include <InterfaceDefs.h>
+#include <Keymap.h>
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+QAtomicPointer<QHaikuKeyMapper::LayoutTable> QHaikuKeyMapper::sLayout;
+
+uint32 QHaikuKeyMapper::translate(uint32 key, uint32 modifiers)
+{
+	if (key > 255)
+		return Qt::Key_unknown;
+
+	const uint32 code = platformHaikuKeyTable.codes[(modifiers & B_NUM_LOCK) ? 1 : 0][key];
+	if (code < Qt::Key_Exclam || code > Qt::Key_AsciiTilde)
+		return code;
+
+	const LayoutTable *table = sLayout.loadAcquire();
+	if (table == NULL)
+		table = layout();
+	return table->codes[key] != 0 ? table->codes[key] : code;
+}
+
+
+void QHaikuKeyMapper::invalidate()
+{
+	// Window loopers may still be reading the old table, it is left alone.
+	// Keymaps change rarely and a table is 1 KiB.
+	sLayout.fetchAndStoreOrdered(NULL);
+}
+
+
+const QHaikuKeyMapper::LayoutTable *QHaikuKeyMapper::layout()
+{
+	// Built outside of any lock and published once. Of loopers racing
+	// here, the first one wins and the others use its table.
+	LayoutTable *table = new LayoutTable;
+	memset(table->codes, 0, sizeof(table->codes));
+
+	BKeymap keymap;
+	if (keymap.SetToCurrent() == B_OK) {
+		for (uint32 key = 0; key < 256; key++) {
+			const uint32 code = platformHaikuKeyTable.codes[0][key];
+			if (code < Qt::Key_Exclam || code > Qt::Key_AsciiTilde)
+				continue;
+
+			char *chars = NULL;
+			int32 numBytes = 0;
+			keymap.GetChars(key, 0, 0, &chars, &numBytes);
+			if (chars != NULL && numBytes == 1) {
+				const char c = chars[0];
+				if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+					table->codes[key] = Qt::Key_A + ((c | 0x20) - 'a');
+			}
+			delete[] chars;
+		}
+	}
+
+	LayoutTable *current = NULL;
+	if (!sLayout.testAndSetOrdered(NULL, table, current)) {
+		delete table;
+		return current;
+	}
+	return table;
+}
+
+QT_END_NAMESPACE
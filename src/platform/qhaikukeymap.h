@@ -42,7 +42,9 @@
 #include <qapplication.h>
 #include <qguiapplication.h>
 
-static uint32 platformHaikuScanCodes[] = {
+#include <qatomic.h>
+
+static constexpr uint32 platformHaikuScanCodes[] = {
 		Qt::Key_Escape,		0x01,
 		Qt::Key_F1,			0x02,
 		Qt::Key_F2,			0x03,
@@ -154,7 +156,7 @@ static uint32 platformHaikuScanCodes[] = {
 		0,					0x00
 	};
 
-static uint32 platformHaikuScanCodes_Numlock[] = {
+static constexpr uint32 platformHaikuScanCodes_Numlock[] = {
 		Qt::Key_7,			0x37,
 		Qt::Key_8,			0x38,
 		Qt::Key_9,			0x39,
@@ -171,4 +173,55 @@ static uint32 platformHaikuScanCodes_Numlock[] = {
 		0,					0x00
 	};
 
+// Direct lookup of the tables above by key code, the second plane with
+// NumLock on. The first entry of a key code wins, like the scan did.
+struct QHaikuKeyTable
+{
+	uint32 codes[2][256];
+};
+
+static constexpr QHaikuKeyTable makeHaikuKeyTable()
+{
+	QHaikuKeyTable table = {};
+	for (int plane = 0; plane < 2; plane++) {
+		for (int key = 0; key < 256; key++)
+			table.codes[plane][key] = Qt::Key_unknown;
+	}
+
+	for (int i = 0; platformHaikuScanCodes[i]; i += 2) {
+		const uint32 key = platformHaikuScanCodes[i + 1] & 0xff;
+		if (table.codes[0][key] == Qt::Key_unknown)
+			table.codes[0][key] = platformHaikuScanCodes[i];
+	}
+
+	for (int key = 0; key < 256; key++)
+		table.codes[1][key] = table.codes[0][key];
+	for (int i = 0; platformHaikuScanCodes_Numlock[i]; i += 2)
+		table.codes[1][platformHaikuScanCodes_Numlock[i + 1] & 0xff] = platformHaikuScanCodes_Numlock[i];
+	return table;
+}
+
+static constexpr QHaikuKeyTable platformHaikuKeyTable = makeHaikuKeyTable();
+
+// Translates key codes to Qt keys. Character keys that produce a Latin
+// letter in the current keymap report that letter, so the A of an AZERTY
+// keyboard is Qt::Key_A. Other layouts keep the US positions shortcuts
+// rely on. The keymap is read once and again after it changed.
+class QHaikuKeyMapper
+{
+public:
+	static uint32 translate(uint32 key, uint32 modifiers);
+	static void invalidate();
+
+private:
+	struct LayoutTable
+	{
+		uint32 codes[256];
+	};
+
+	static const LayoutTable *layout();
+
+	static QAtomicPointer<LayoutTable> sLayout;
+};
+
 #endif
@@ -47,6 +47,7 @@
 
 #include <QtGui/QScreen>
 #include <QtGui/QWindow>
+#include <QtGui/QRegion>
 
 QT_BEGIN_NAMESPACE
 
@@ -58,8 +59,17 @@ QHaikuNativeInterface::QHaikuNativeInterface(QHaikuIntegration *integration)
 
 void *QHaikuNativeInterface::nativeResourceForWindow(const QByteArray &resource, QWindow *window)
 {
-	Q_UNUSED(resource)
-	Q_UNUSED(window)
+	QHaikuWindow *haikuWindow = window != NULL ? static_cast<QHaikuWindow*>(window->handle()) : NULL;
+	if (haikuWindow == NULL)
+		return 0;
+
+	if (resource == "flushstats")
+		return haikuWindow->flushStats();
+	if (resource == "swapstats")
+		return haikuWindow->swapStats();
+	if (resource == "eventlatency")
+		return haikuWindow->eventLatency();
+
     return 0;
 }
 
@@ -72,7 +82,8 @@ void *QHaikuNativeInterface::nativeResourceForScreen(const QByteArray &resource,
 
 void *QHaikuNativeInterface::nativeResourceForIntegration(const QByteArray &resource)
 {
-	Q_UNUSED(resource)
+	if (resource == "glbufferpool")
+		return m_integration->glBufferPool();
     return 0;
 }
 
@@ -85,9 +96,26 @@ void *QHaikuNativeInterface::nativeResourceForContext(const QByteArray &resource
 
 void QHaikuNativeInterface::setWindowProperty(QPlatformWindow *window, const QString &name, const QVariant &value)
 {
-	Q_UNUSED(window)
-	Q_UNUSED(name)
-	Q_UNUSED(value)
+	QHaikuWindow *haikuWindow = static_cast<QHaikuWindow*>(window);
+	if (haikuWindow == NULL)
+		return;
+
+	if (name == QLatin1String("gldamage")) {
+		// QRegion, QRect or a list of QRect, consumed by the next swap.
+		QRegion damage;
+		if (value.canConvert<QRegion>()) {
+			damage = value.value<QRegion>();
+		} else if (value.canConvert<QRect>()) {
+			damage = value.toRect();
+		} else {
+			const QVariantList rects = value.toList();
+			for (const QVariant &rect : rects)
+				damage += rect.toRect();
+		}
+		haikuWindow->setOpenGLDamage(damage);
+	} else if (name == QLatin1String("mousehistory")) {
+		haikuWindow->setPointerHistory(value.toBool());
+	}
 }
 
 QPlatformNativeInterface::NativeResourceForIntegrationFunction QHaikuNativeInterface::nativeResourceFunctionForIntegration(const QByteArray &resource)
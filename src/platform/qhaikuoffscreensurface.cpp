@@ -39,20 +39,41 @@
 ****************************************************************************/
 
 #include "qhaikuoffscreensurface.h"
+#include "qhaikuintegration.h"
+
+#include <private/qguiapplication_p.h>
+
+#include <Bitmap.h>
 
 QT_BEGIN_NAMESPACE
 
 QHaikuOffscreenSurface::QHaikuOffscreenSurface(QOffscreenSurface *offscreenSurface)
 	: QPlatformOffscreenSurface(offscreenSurface)
 {
-	QSize size = offscreenSurface->size();
-	m_offscreenBuffer = malloc(size.width() * size.height() * 4);
+	QHaikuIntegration *integration = static_cast<QHaikuIntegration*>(QGuiApplicationPrivate::platformIntegration());
+	m_offscreenBitmap = integration->glBufferPool()->acquire(offscreenSurface->size());
 }
 
 QHaikuOffscreenSurface::~QHaikuOffscreenSurface()
 {
-	if (isValid())
-		free(m_offscreenBuffer);
+	if (!isValid())
+		return;
+
+	QHaikuIntegration *integration = static_cast<QHaikuIntegration*>(QGuiApplicationPrivate::platformIntegration());
+	if (integration != NULL && integration->glBufferPool() != NULL)
+		integration->glBufferPool()->release(m_offscreenBitmap);
+	else
+		delete m_offscreenBitmap;
+}
+
+void *QHaikuOffscreenSurface::openGLBuffer()
+{
+	return isValid() ? m_offscreenBitmap->Bits() : NULL;
+}
+
+int QHaikuOffscreenSurface::openGLRowLength() const
+{
+	return isValid() ? m_offscreenBitmap->BytesPerRow() / 4 : 0;
 }
 
 QSurfaceFormat QHaikuOffscreenSurface::format() const
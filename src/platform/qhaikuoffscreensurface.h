@@ -43,6 +43,8 @@
 #include <QtGui/QOffscreenSurface>
 #include <QtGui/QSurface>
 
+class BBitmap;
+
 #ifndef QHAIKUOFFSCREENSURFACE_H
 #define QHAIKUOFFSCREENSURFACE_H
 
@@ -55,12 +57,14 @@ public:
     ~QHaikuOffscreenSurface();
 
     QSurfaceFormat format() const override;
-    bool isValid() const override { return m_offscreenBuffer != NULL; }
+    bool isValid() const override { return m_offscreenBitmap != NULL; }
 
-	void *openGLBuffer() { return m_offscreenBuffer; }
+	void *openGLBuffer();
+	int openGLRowLength() const;
 
 private:
-	void* m_offscreenBuffer;
+	// Taken from the GL buffer pool, so it may be wider than the surface.
+	BBitmap *m_offscreenBitmap;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,212 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qhaikupresenter.h"
+#include "qhaikuwindow.h"
+
+QT_BEGIN_NAMESPACE
+
+QHaikuPresenter::QHaikuPresenter()
+	: m_busy(NULL)
+	, m_thread(-1)
+	, m_quit(false)
+{
+	m_thread = spawn_thread(presentThread, "Qt GL presenter", B_DISPLAY_PRIORITY, this);
+	if (m_thread >= 0)
+		resume_thread(m_thread);
+}
+
+
+QHaikuPresenter::~QHaikuPresenter()
+{
+	m_mutex.lock();
+	m_quit = true;
+	m_queue.clear();
+	m_wakeup.wakeAll();
+	m_mutex.unlock();
+
+	if (m_thread >= 0) {
+		status_t result;
+		wait_for_thread(m_thread, &result);
+	}
+}
+
+
+void QHaikuPresenter::present(QHaikuWindow *window, const QList<QRect> &rects, const QSize &size)
+{
+	Request request;
+	request.window = window;
+	request.rects = rects;
+	request.size = size;
+
+	QMutexLocker locker(&m_mutex);
+	if (m_thread < 0) {
+		locker.unlock();
+		draw(request);
+		return;
+	}
+
+	// Callers wait for the previous frame of a window before reading the
+	// next one back, so a window is queued at most once.
+	m_queue.append(request);
+	m_wakeup.wakeOne();
+}
+
+
+bool QHaikuPresenter::isPending(QHaikuWindow *window) const
+{
+	if (m_busy == window)
+		return true;
+	for (const Request &request : m_queue) {
+		if (request.window == window)
+			return true;
+	}
+	return false;
+}
+
+
+void QHaikuPresenter::waitForPresent(QHaikuWindow *window)
+{
+	QMutexLocker locker(&m_mutex);
+	while (isPending(window))
+		m_done.wait(&m_mutex);
+}
+
+
+void QHaikuPresenter::cancel(QHaikuWindow *window)
+{
+	QMutexLocker locker(&m_mutex);
+	for (int i = m_queue.size() - 1; i >= 0; --i) {
+		if (m_queue.at(i).window == window)
+			m_queue.removeAt(i);
+	}
+	while (m_busy == window)
+		m_done.wait(&m_mutex);
+}
+
+
+int32 QHaikuPresenter::presentThread(void *data)
+{
+	static_cast<QHaikuPresenter*>(data)->run();
+	return B_OK;
+}
+
+
+void QHaikuPresenter::run()
+{
+	for (;;) {
+		m_mutex.lock();
+		while (m_queue.isEmpty() && !m_quit)
+			m_wakeup.wait(&m_mutex);
+		if (m_quit) {
+			m_mutex.unlock();
+			break;
+		}
+		Request request = m_queue.takeFirst();
+		m_busy = request.window;
+		m_mutex.unlock();
+
+		draw(request);
+
+		m_mutex.lock();
+		m_busy = NULL;
+		m_done.wakeAll();
+		m_mutex.unlock();
+	}
+}
+
+
+void QHaikuPresenter::draw(const Request &request)
+{
+	QHaikuWindow *window = request.window;
+	QHaikuFrameStats *stats = window->swapStats();
+	QHaikuSurfaceView *view = QHaikuWindow::viewForWinId(window->winId());
+	if (view == NULL || window->openGLBitmap() == NULL)
+		return;
+
+	bigtime_t phaseStart = system_time();
+	status_t locked = view->LockLooperWithTimeout(100000);
+	stats->addSample(QHaikuFrameStats::PhaseLock, system_time() - phaseStart);
+	if (locked != B_OK) {
+		// The frame is dropped and the view misses its damage, the next
+		// swap reads back and draws the whole surface. The render thread
+		// waits for this request before looking at the flag.
+		window->setOpenGLBitmapComplete(false);
+		return;
+	}
+
+	phaseStart = system_time();
+
+	QHaikuWindow *topHaikuWin = window->topLevelWindow();
+
+	view->SetDrawingMode(B_OP_COPY);
+	BRegion region = topHaikuWin->getClippingRegion();
+	view->ConstrainClippingRegion(&region);
+	quint64 bytes = 0;
+	for (const QRect &rect : request.rects) {
+		BRect frame(rect.left(), rect.top(), rect.right(), rect.bottom());
+		view->DrawBitmapAsync(window->openGLBitmap(), frame, frame);
+		bytes += quint64(rect.width()) * rect.height() * 4;
+	}
+	BRegion allregion(BRect(0, 0, request.size.width(), request.size.height()));
+	allregion.Exclude(&region);
+	view->ConstrainClippingRegion(&allregion);
+
+	for (int i = 0; i < topHaikuWin->fakeChildList()->size(); ++i) {
+		QHaikuWindow *win = topHaikuWin->fakeChildList()->at(i);
+		if (!win->window()->isTopLevel() && win->window()->isVisible() && win->openGLBitmap() != NULL) {
+			QPoint origin = win->mapToGlobal(QPoint()) - topHaikuWin->mapToGlobal(QPoint());
+			QSize size = win->openGLBitmapSize();
+			view->DrawBitmapAsync(win->openGLBitmap(), BRect(0, 0, size.width() - 1, size.height() - 1),
+				BRect(origin.x(), origin.y(), origin.x() + size.width() - 1, origin.y() + size.height() - 1));
+		}
+	}
+
+	stats->addSample(QHaikuFrameStats::PhaseDraw, system_time() - phaseStart);
+	phaseStart = system_time();
+
+	view->Sync();
+	view->UnlockLooper();
+
+	stats->addSample(QHaikuFrameStats::PhaseSync, system_time() - phaseStart);
+	stats->addFrame(bytes);
+}
+
+QT_END_NAMESPACE
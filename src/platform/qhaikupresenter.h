@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** Copyright (C) 2017 The Qt Company Ltd.
+** Copyright (C) 2015-2022 Gerasim Troeglazov,
+** Contact: 3dEyes@gmail.com
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QHAIKUPRESENTER_H
+#define QHAIKUPRESENTER_H
+
+#include <qlist.h>
+#include <qrect.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+
+#include <OS.h>
+
+QT_BEGIN_NAMESPACE
+
+class QHaikuWindow;
+
+// Draws finished GL frames of top level windows to their views on its own
+// thread, so render threads do not wait for window loopers.
+class QHaikuPresenter
+{
+public:
+    QHaikuPresenter();
+    ~QHaikuPresenter();
+
+    void present(QHaikuWindow *window, const QList<QRect> &rects, const QSize &size);
+    void waitForPresent(QHaikuWindow *window);
+    void cancel(QHaikuWindow *window);
+
+private:
+    struct Request {
+        QHaikuWindow *window;
+        QList<QRect> rects;
+        QSize size;
+    };
+
+    static int32 presentThread(void *data);
+    void run();
+    void draw(const Request &request);
+    bool isPending(QHaikuWindow *window) const;
+
+    QMutex m_mutex;
+    QWaitCondition m_wakeup;
+    QWaitCondition m_done;
+    QList<Request> m_queue;
+    QHaikuWindow *m_busy;
+    thread_id m_thread;
+    bool m_quit;
+};
+
+QT_END_NAMESPACE
+
+#endif // QHAIKUPRESENTER_H
@@ -50,12 +50,224 @@
 
 #include <qdebug.h>
 
+#include <Autolock.h>
+
 QT_BEGIN_NAMESPACE
 
+// Retrace waits that may fail in a row before the clock falls back to a
+// timer, and how long it stays with the timer before trying again.
+static const int kMaxRetraceFailures = 8;
+static const bigtime_t kRetraceProbeInterval = 5000000;
+
+static bigtime_t refreshInterval(BScreen *screen)
+{
+	display_mode mode;
+	if (screen->GetMode(&mode) == B_OK
+		&& mode.timing.h_total > 0 && mode.timing.v_total > 0) {
+		double refresh = mode.timing.pixel_clock * 1000.0
+			/ (double(mode.timing.h_total) * mode.timing.v_total);
+		if (refresh >= 20.0 && refresh <= 500.0)
+			return bigtime_t(1000000.0 / refresh);
+	}
+	return 1000000 / 60;
+}
+
+
+QHaikuFrameClock::QHaikuFrameClock()
+	: m_lock("QHaikuFrameClock")
+	, m_retraceWaiters(0)
+	, m_frameCount(1)
+	, m_lastTick(0)
+	, m_thread(-1)
+	, m_quit(false)
+	, m_retraceAvailable(true)
+	, m_retraceFailures(0)
+	, m_retraceProbe(0)
+	, m_lastFrame(0)
+{
+	BScreen screen(B_MAIN_SCREEN_ID);
+	m_interval = refreshInterval(&screen);
+
+	m_wakeup = create_sem(0, "QHaikuFrameClock wakeup");
+	m_retrace = create_sem(0, "QHaikuFrameClock retrace");
+	m_thread = spawn_thread(clockThread, "Qt frame clock", B_URGENT_DISPLAY_PRIORITY, this);
+	if (m_thread >= 0)
+		resume_thread(m_thread);
+}
+
+
+QHaikuFrameClock::~QHaikuFrameClock()
+{
+	m_lock.Lock();
+	m_quit = true;
+	m_pending.clear();
+	if (m_retraceWaiters > 0)
+		release_sem_etc(m_retrace, m_retraceWaiters, 0);
+	m_lock.Unlock();
+
+	release_sem(m_wakeup);
+	if (m_thread >= 0) {
+		status_t result;
+		wait_for_thread(m_thread, &result);
+	}
+	delete_sem(m_wakeup);
+	delete_sem(m_retrace);
+}
+
+
+void QHaikuFrameClock::requestFrame(QHaikuWindow *window)
+{
+	BAutolock locker(m_lock);
+	if (m_pending.contains(window))
+		return;
+	m_pending.append(window);
+	if (m_pending.size() == 1)
+		release_sem(m_wakeup);
+}
+
+
+void QHaikuFrameClock::cancelFrame(QHaikuWindow *window)
+{
+	BAutolock locker(m_lock);
+	m_pending.removeAll(window);
+}
+
+
+// Number of the current display frame, counting from 1. The clock only
+// ticks while somebody waits for it, frames that passed since then are
+// added from the refresh interval.
+quint64 QHaikuFrameClock::currentFrame()
+{
+	BAutolock locker(m_lock);
+	if (m_lastTick == 0)
+		return m_frameCount;
+	return m_frameCount + quint64((system_time() - m_lastTick) / m_interval);
+}
+
+
+// Blocks the calling thread until the clock ticked into the given frame,
+// used to pace GL swaps. Returns false if no tick came in time.
+bool QHaikuFrameClock::waitUntilFrame(quint64 frame)
+{
+	BAutolock locker(m_lock);
+	if (m_thread < 0 || m_quit)
+		return false;
+	if (m_frameCount >= frame)
+		return true;
+
+	const quint64 target = frame;
+	m_retraceWaiters++;
+	if (m_retraceWaiters == 1 && m_pending.isEmpty())
+		release_sem(m_wakeup);
+
+	bool ticked = true;
+	while (m_frameCount < target && !m_quit) {
+		m_lock.Unlock();
+		status_t status = acquire_sem_etc(m_retrace, 1, B_RELATIVE_TIMEOUT, m_interval * 4);
+		m_lock.Lock();
+		if (status != B_OK && status != B_INTERRUPTED) {
+			ticked = false;
+			break;
+		}
+	}
+	m_retraceWaiters--;
+	return ticked && m_frameCount >= target;
+}
+
+
+int32 QHaikuFrameClock::clockThread(void *data)
+{
+	static_cast<QHaikuFrameClock*>(data)->run();
+	return B_OK;
+}
+
+
+void QHaikuFrameClock::waitForFrame(BScreen *screen)
+{
+	// Drivers that fell back after timeouts, say during a mode switch,
+	// get another try now and then.
+	if (!m_retraceAvailable && m_retraceProbe > 0 && system_time() >= m_retraceProbe) {
+		m_retraceAvailable = true;
+		m_retraceFailures = kMaxRetraceFailures - 1;
+	}
+
+	if (m_retraceAvailable) {
+		status_t status = screen->WaitForRetrace(m_interval * 2);
+		if (status == B_OK) {
+			m_retraceFailures = 0;
+			m_retraceProbe = 0;
+			m_lastFrame = system_time();
+			return;
+		}
+		// Not every driver can wait for the retrace, fall back to a timer
+		// running at the refresh rate. A driver that merely timed out a
+		// few times is probed again later.
+		if (status == B_UNSUPPORTED) {
+			m_retraceAvailable = false;
+			m_retraceProbe = 0;
+		} else if (++m_retraceFailures >= kMaxRetraceFailures) {
+			m_retraceAvailable = false;
+			m_retraceProbe = system_time() + kRetraceProbeInterval;
+		}
+	}
+
+	bigtime_t now = system_time();
+	bigtime_t next = m_lastFrame + m_interval;
+	if (next < now)
+		next = now + m_interval - (now - m_lastFrame) % m_interval;
+	snooze_until(next, B_SYSTEM_TIMEBASE);
+	m_lastFrame = next;
+}
+
+
+void QHaikuFrameClock::run()
+{
+	BScreen screen(B_MAIN_SCREEN_ID);
+
+	for (;;) {
+		while (acquire_sem(m_wakeup) == B_INTERRUPTED)
+			;
+
+		m_lock.Lock();
+		bool quit = m_quit;
+		m_lock.Unlock();
+		if (quit)
+			break;
+
+		waitForFrame(&screen);
+
+		BAutolock locker(m_lock);
+		if (m_quit)
+			break;
+		// Retraces also pass while nobody waits, keep the count in step
+		// with the display.
+		const bigtime_t now = system_time();
+		if (m_lastTick > 0 && now - m_lastTick > m_interval + m_interval / 2)
+			m_frameCount += quint64((now - m_lastTick + m_interval / 2) / m_interval);
+		else
+			m_frameCount++;
+		m_lastTick = now;
+		// Keep ticking for as long as swaps are waiting on the clock.
+		if (m_retraceWaiters > 0) {
+			release_sem_etc(m_retrace, m_retraceWaiters, 0);
+			release_sem(m_wakeup);
+		}
+		for (QHaikuWindow *window : m_pending) {
+			QMetaObject::invokeMethod(window, [window]() {
+				if (window->hasPendingUpdateRequest())
+					window->deliverUpdateRequest();
+			}, Qt::QueuedConnection);
+		}
+		m_pending.clear();
+	}
+}
+
+
 QHaikuScreen::QHaikuScreen()
 	: QPlatformScreen()
     , m_cursor(new QHaikuCursor)
 	, m_screen(new BScreen(B_MAIN_SCREEN_ID))
+	, m_frameClock(new QHaikuFrameClock)
 {
 	Q_ASSERT(m_screen->IsValid());
 }
@@ -63,6 +275,7 @@ QHaikuScreen::QHaikuScreen()
 
 QHaikuScreen::~QHaikuScreen()
 {
+    delete m_frameClock;
     delete m_cursor;
     delete m_screen;
 }
@@ -157,4 +370,9 @@ Qt::ScreenOrientation QHaikuScreen::orientation() const
     return Qt::PrimaryOrientation;
 }
 
+qreal QHaikuScreen::refreshRate() const
+{
+    return 1000000.0 / m_frameClock->frameInterval();
+}
+
 QT_END_NAMESPACE
@@ -50,13 +50,53 @@
 #include <qscopedpointer.h>
 #include <qimage.h>
 #include <qbitmap.h>
+#include <qlist.h>
 
 #include <Screen.h>
 #include <View.h>
 #include <Bitmap.h>
+#include <Locker.h>
+#include <OS.h>
 
 QT_BEGIN_NAMESPACE
 
+class QHaikuWindow;
+
+class QHaikuFrameClock
+{
+public:
+    QHaikuFrameClock();
+    ~QHaikuFrameClock();
+
+    void requestFrame(QHaikuWindow *window);
+    void cancelFrame(QHaikuWindow *window);
+    quint64 currentFrame();
+    bool waitUntilFrame(quint64 frame);
+
+    bigtime_t frameInterval() const { return m_interval; }
+    bool hasRetrace() const { return m_retraceAvailable; }
+
+private:
+    static int32 clockThread(void *data);
+    void run();
+    void waitForFrame(BScreen *screen);
+
+    BLocker m_lock;
+    sem_id m_wakeup;
+    sem_id m_retrace;
+    int m_retraceWaiters;
+    quint64 m_frameCount;
+    bigtime_t m_lastTick;
+    thread_id m_thread;
+    bool m_quit;
+    bool m_retraceAvailable;
+    int m_retraceFailures;
+    bigtime_t m_retraceProbe;
+    bigtime_t m_interval;
+    bigtime_t m_lastFrame;
+    QList<QHaikuWindow*> m_pending;
+};
+
 class QHaikuScreen : public QPlatformScreen
 {
 public:
@@ -76,10 +116,14 @@ public:
     QDpi logicalDpi() const override;
     Qt::ScreenOrientation nativeOrientation() const override;
     Qt::ScreenOrientation orientation() const override;
+    qreal refreshRate() const override;
+
+    QHaikuFrameClock *frameClock() const { return m_frameClock; }
 
 private:
     QHaikuCursor *m_cursor;
     BScreen *m_screen;
+    QHaikuFrameClock *m_frameClock;
 };
 
 QT_END_NAMESPACE
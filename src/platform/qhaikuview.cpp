@@ -62,7 +62,10 @@ QHaikuSurfaceView::QHaikuSurfaceView(BRect rect)
 	: QObject()
 	, BView(rect, "QHaikuSurfaceView", B_FOLLOW_ALL, B_WILL_DRAW),
 	lastMouseState(Qt::NoButton),
-	lastMouseButton(Qt::NoButton)
+	lastMouseButton(Qt::NoButton),
+	fFrontBitmap(NULL),
+	fPointerHistory(false),
+	fExposedToQt(0)
 {
     qRegisterMetaType<QMimeData*>();
     qRegisterMetaType<QEvent::Type>();
@@ -81,7 +84,41 @@ void
 QHaikuSurfaceView::Draw(BRect rect)
 {
 	QRegion region(QRect(rect.left, rect.top, rect.IntegerWidth() + 1, rect.IntegerHeight() + 1));
-	Q_EMIT exposeEvent(region);
+
+	// Uncovered areas that were flushed before are redrawn right here from
+	// the last flushed bitmap, Qt only has to hear about the rest. Once the
+	// window went out of sight for Qt, the first update goes to Qt whole,
+	// so that it counts the window as exposed again.
+	const bool exposed = fExposedToQt.fetchAndStoreRelaxed(1) != 0;
+	if (fFrontBitmap != NULL) {
+		const QRegion replay = region & fFrontValid;
+		for (const QRect &r : replay) {
+			BRect bounds(r.left(), r.top(), r.right(), r.bottom());
+			DrawBitmapAsync(fFrontBitmap, bounds, bounds);
+		}
+		if (exposed)
+			region -= replay;
+	}
+
+	if (!region.isEmpty())
+		Q_EMIT exposeEvent(region);
+}
+
+void
+QHaikuSurfaceView::setFrontBuffer(BBitmap *bitmap, const QRegion &valid)
+{
+	// Called with the looper locked.
+	fFrontBitmap = bitmap;
+	fFrontValid = bitmap != NULL ? valid : QRegion();
+}
+
+void
+QHaikuSurfaceView::setPointerHistory(bool enabled)
+{
+	// Called with the looper locked. Without history app_server only
+	// sends the latest position of the pointer.
+	fPointerHistory = enabled;
+	SetEventMask(0, enabled ? 0 : B_NO_POINTER_HISTORY);
 }
 
 Qt::MouseButtons
@@ -126,6 +163,31 @@ QHaikuSurfaceView::hostToQtModifiers(uint32 keyState) const
     return modifiers;
 }
 
+void
+QHaikuSurfaceView::postEvent(const QHaikuEvent &event)
+{
+	static_cast<QtHaikuWindow*>(Window())->postEvent(event);
+}
+
+void
+QHaikuSurfaceView::postMouseEvent(const QPoint &localPosition, const QPoint &globalPosition,
+	Qt::MouseButtons buttons, Qt::MouseButton button, QEvent::Type type)
+{
+	QHaikuEvent event;
+	event.type = QHaikuEvent::Mouse;
+	event.modifiers = hostToQtModifiers(modifiers());
+	event.when = QHaikuEvent::timestamp(Window()->CurrentMessage());
+	event.mouse.localX = localPosition.x();
+	event.mouse.localY = localPosition.y();
+	event.mouse.globalX = globalPosition.x();
+	event.mouse.globalY = globalPosition.y();
+	event.mouse.buttons = buttons;
+	event.mouse.button = button;
+	event.mouse.type = type;
+	event.mouse.source = Qt::MouseEventNotSynthesized;
+	postEvent(event);
+}
+
 bool
 QHaikuSurfaceView::isSizeGripperContains(BPoint point)
 {
@@ -151,14 +213,13 @@ QHaikuSurfaceView::MouseDown(BPoint point)
 	if (isSizeGripperContains(point))
 		return;
 
-	SetMouseEventMask(B_POINTER_EVENTS, B_LOCK_WINDOW_FOCUS | B_NO_POINTER_HISTORY);
+	SetMouseEventMask(B_POINTER_EVENTS, B_LOCK_WINDOW_FOCUS | (fPointerHistory ? 0 : B_NO_POINTER_HISTORY));
 
 	uint32 buttons = Window()->CurrentMessage()->FindInt32("buttons");
 	lastMouseState = hostToQtButtons(buttons);
 	lastMouseButton = hostToQtButton(buttons);
 
-	Q_EMIT mouseEvent(localPoint, globalPoint, lastMouseState, lastMouseButton, QEvent::MouseButtonPress,
-		hostToQtModifiers(modifiers()), Qt::MouseEventNotSynthesized);
+	postMouseEvent(localPoint, globalPoint, lastMouseState, lastMouseButton, QEvent::MouseButtonPress);
 }
 
 void 
@@ -177,8 +238,7 @@ QHaikuSurfaceView::MouseUp(BPoint point)
 
 	Qt::MouseButtons state = hostToQtButton(buttons);
 
-	Q_EMIT mouseEvent(localPoint, globalPoint, state, lastMouseButton, QEvent::MouseButtonRelease,
-		hostToQtModifiers(modifiers()), Qt::MouseEventNotSynthesized);
+	postMouseEvent(localPoint, globalPoint, state, lastMouseButton, QEvent::MouseButtonRelease);
 }
 
 void 
@@ -190,11 +250,15 @@ QHaikuSurfaceView::MouseMoved(BPoint point, uint32 transit, const BMessage *msg)
 		case B_INSIDE_VIEW:
 			break;
 		case B_ENTERED_VIEW:
-			Q_EMIT enteredView();
-			break;
 		case B_EXITED_VIEW:
-			Q_EMIT exitedView();
+		{
+			QHaikuEvent event;
+			event.type = transit == B_ENTERED_VIEW ? QHaikuEvent::Enter : QHaikuEvent::Leave;
+			event.modifiers = hostToQtModifiers(modifiers());
+			event.when = QHaikuEvent::timestamp(Window()->CurrentMessage());
+			postEvent(event);
 			break;
+		}
     }
 
 	BPoint s_point = ConvertToScreen(point);
@@ -246,14 +310,23 @@ QHaikuSurfaceView::MouseMoved(BPoint point, uint32 transit, const BMessage *msg)
 			float pressure = Window()->CurrentMessage()->FindFloat("be:tablet_pressure");
 			int32 eraser = Window()->CurrentMessage()->FindFloat("be:tablet_eraser");
 			QPointF globalTablePoint(x * scr.Frame().Width(), y * scr.Frame().Height());
-			Q_EMIT tabletEvent(QPointF(localPoint), QPointF(globalPoint), int(QInputDevice::DeviceType::Stylus),
-				eraser==0 ? int(QPointingDevice::PointerType::Pen) : int(QPointingDevice::PointerType::Eraser), hostToQtButtons(buttons),
-				pressure, hostToQtModifiers(modifiers()));
-			Q_EMIT mouseEvent(localPoint, globalPoint, Qt::NoButton, Qt::NoButton, QEvent::MouseMove,
-				hostToQtModifiers(modifiers()), Qt::MouseEventNotSynthesized);
+			QHaikuEvent event;
+			event.type = QHaikuEvent::Tablet;
+			event.modifiers = hostToQtModifiers(modifiers());
+			event.when = QHaikuEvent::timestamp(Window()->CurrentMessage());
+			event.tablet.localX = localPoint.x();
+			event.tablet.localY = localPoint.y();
+			event.tablet.globalX = globalPoint.x();
+			event.tablet.globalY = globalPoint.y();
+			event.tablet.pressure = pressure;
+			event.tablet.device = int(QInputDevice::DeviceType::Stylus);
+			event.tablet.pointerType = eraser == 0 ? int(QPointingDevice::PointerType::Pen)
+				: int(QPointingDevice::PointerType::Eraser);
+			event.tablet.buttons = hostToQtButtons(buttons);
+			postEvent(event);
+			postMouseEvent(localPoint, globalPoint, Qt::NoButton, Qt::NoButton, QEvent::MouseMove);
 		} else {
-			Q_EMIT mouseEvent(localPoint, globalPoint, hostToQtButtons(buttons), Qt::NoButton, QEvent::MouseMove,
-				hostToQtModifiers(modifiers()), Qt::MouseEventNotSynthesized);
+			postMouseEvent(localPoint, globalPoint, hostToQtButtons(buttons), Qt::NoButton, QEvent::MouseMove);
 		}
 	}
 }
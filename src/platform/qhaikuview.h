@@ -45,6 +45,7 @@
 #include <qpa/qplatformwindow.h>
 #include <qpa/qplatformdrag.h>
 #include <qregion.h>
+#include <qatomic.h>
 #include <qdebug.h>
 
 #include <SupportDefs.h>
@@ -53,6 +54,8 @@
 #include <Point.h>
 #include <Rect.h>
 
+#include "qhaikueventring.h"
+
 #define Q_HAIKU_MOUSE_EVENTS_TIME 10000
 
 class QHaikuSurfaceView : public QObject, public BView
@@ -70,36 +73,33 @@ class QHaikuSurfaceView : public QObject, public BView
 		Qt::MouseButton hostToQtButton(uint32 buttons) const;
 		Qt::MouseButtons hostToQtButtons(uint32 buttons) const;
 		Qt::KeyboardModifiers hostToQtModifiers(uint32 keyState) const;
+
+		void setFrontBuffer(BBitmap *bitmap, const QRegion &valid);
+		void setPointerHistory(bool enabled);
+		// Called when Qt stops considering the window exposed, the next
+		// Draw() then exposes everything it updates.
+		void setHiddenFromQt() { fExposedToQt.storeRelaxed(0); }
 		
 		QPoint	lastLocalMousePoint;
 		QPoint 	lastGlobalMousePoint;
 		
  private:
 		bool isSizeGripperContains(BPoint);
+		void postEvent(const QHaikuEvent &event);
+		void postMouseEvent(const QPoint &localPosition, const QPoint &globalPosition,
+			Qt::MouseButtons buttons, Qt::MouseButton button, QEvent::Type type);
 		Qt::MouseButtons lastMouseState;
 		Qt::MouseButton lastMouseButton;
+		BBitmap *fFrontBitmap;
+		QRegion fFrontValid;
+		bool fPointerHistory;
+		QAtomicInt fExposedToQt;
  Q_SIGNALS:
-		void mouseEvent(const QPoint &localPosition,
-			const QPoint &globalPosition,
-			Qt::MouseButtons state,
-			Qt::MouseButton button,
-			QEvent::Type type,
-			Qt::KeyboardModifiers modifiers,
-			Qt::MouseEventSource source);
 		void mouseDragEvent(const QPoint &localPosition,
 			Qt::DropActions actions,
 			QMimeData *data,
 			Qt::MouseButtons buttons,
 			Qt::KeyboardModifiers modifiers);
-		void tabletEvent(const QPointF &localPosition,
-			const QPointF &globalPosition,
-			int device,
-			int pointerType,
-			Qt::MouseButtons buttons,
-			float pressure,
-			Qt::KeyboardModifiers modifiers);
-	    void enteredView();
-		void exitedView();
 		void exposeEvent(QRegion region);
 };
 
@@ -41,6 +41,7 @@
 #include "qhaikuwindow.h"
 #include "qhaikukeymap.h"
 #include "qhaikusettings.h"
+#include "qhaikuintegration.h"
 
 #include <private/qguiapplication_p.h>
 #include <private/qwindow_p.h>
@@ -61,36 +62,14 @@
 #include <private/qwindow_p.h>
 
 #include <qdebug.h>
+#include <qpointer.h>
+#include <qthread.h>
+#include <qstylehints.h>
+#include <qfontmetrics.h>
 
-QT_BEGIN_NAMESPACE
-
-static uint32 translateKeyCode(uint32 key)
-{
-	uint32 code = Qt::Key_unknown;
-	uint32 i = 0;
-	if ( modifiers() & B_NUM_LOCK ) {
-	    while (platformHaikuScanCodes_Numlock[i]) {
-			if ( key == platformHaikuScanCodes_Numlock[i + 1]) {
-				code = platformHaikuScanCodes_Numlock[i];
-				break;
-			}
-			i += 2;
-		}
-		if (code != Qt::Key_unknown)
-			return code;
-	}
-
-	i = 0;
-    while (platformHaikuScanCodes[i]) {
-		if ( key == platformHaikuScanCodes[i + 1]) {
-			code = platformHaikuScanCodes[i];
-			break;
-		}
-		i += 2;
-	}
-	return code;
-}
+#include <math.h>
 
+QT_BEGIN_NAMESPACE
 
 static bool focusWindowChangeQueued(const QWindow *window)
 {
@@ -131,8 +110,10 @@ QtHaikuWindow::QtHaikuWindow(QHaikuWindow *qwindow,
 		, BWindow(frame, title, look, feel, flags)
 {
 	fQWindow = qwindow;
+	fFlushFence.reset(new QHaikuFlushFence);
+	fEventRing.reset(new QHaikuEventRing);
 	fView = new QHaikuSurfaceView(Bounds());
-	fView->SetEventMask(0, B_NO_POINTER_HISTORY);
+	fView->setPointerHistory(false);
  	AddChild(fView);
  	Qt::WindowType type =  static_cast<Qt::WindowType>(int(qwindow->window()->flags() & Qt::WindowType_Mask));
 	bool dialog = ((type == Qt::Dialog) || (type == Qt::Sheet) || (type == Qt::MSWindowsFixedSizeDialogHint));
@@ -154,6 +135,45 @@ QHaikuSurfaceView* QtHaikuWindow::View(void)
 }
 
 
+void QtHaikuWindow::postEvent(const QHaikuEvent &event)
+{
+	// The looper thread is the only producer of the ring. Hooks the Qt
+	// thread calls itself, like Minimize(), are handled right away, after
+	// everything queued before them. Any other thread goes through the
+	// looper.
+	if (find_thread(NULL) != Thread()) {
+		if (QThread::currentThread() == fQWindow->thread()) {
+			if (fQWindow->drainEvents())
+				fQWindow->dispatchEvent(event);
+		} else {
+			BMessage message(kPostEvent);
+			message.AddData("event", B_RAW_TYPE, &event, sizeof(event));
+			PostMessage(&message);
+		}
+		return;
+	}
+
+	// The ring only fills up while the Qt thread is busy. A move is
+	// superseded by the next one anyway, anything else is queued behind
+	// the ring without blocking the looper.
+	if (event.type == QHaikuEvent::Mouse && event.mouse.type == QEvent::MouseMove
+		&& fEventRing->isBacklogged())
+		return;
+	fEventRing->push(event);
+}
+
+
+static QHaikuEvent stateEvent(const BMessage *message, QHaikuEvent::Type type, bool active = false)
+{
+	QHaikuEvent event;
+	memset(&event, 0, sizeof(event));
+	event.type = type;
+	event.when = QHaikuEvent::timestamp(message);
+	event.state.active = active;
+	return event;
+}
+
+
 void QtHaikuWindow::DispatchMessage(BMessage *msg, BHandler *handler)
 {
 	switch(msg->what) {
@@ -164,11 +184,7 @@ void QtHaikuWindow::DispatchMessage(BMessage *msg, BHandler *handler)
 			{
 				uint32 modifiers = msg->FindInt32("modifiers");
 				uint32 key = msg->FindInt32("key");
-				QString text;
-				const char* bytes;
-				if(msg->FindString("bytes", &bytes) == B_OK)
-					text = QString::fromUtf8(bytes);
-				uint32 qt_keycode = translateKeyCode(key);
+				uint32 qt_keycode = QHaikuKeyMapper::translate(key, modifiers);
 				if (qt_keycode == Qt::Key_Print)
 					break;
 				if (qt_keycode == Qt::Key_Tab && modifiers & B_CONTROL_KEY)
@@ -180,7 +196,27 @@ void QtHaikuWindow::DispatchMessage(BMessage *msg, BHandler *handler)
 				if (qt_keycode == Qt::Key_M && modifiers & B_COMMAND_KEY && modifiers & B_CONTROL_KEY)
 					break;
 				bool press = msg->what == B_KEY_DOWN || msg->what == B_UNMAPPED_KEY_DOWN;
-				Q_EMIT keyEvent(press ? QEvent::KeyPress : QEvent::KeyRelease, qt_keycode, fView->hostToQtModifiers(modifiers), text);
+
+				QHaikuEvent event;
+				event.type = QHaikuEvent::Key;
+				event.modifiers = fView->hostToQtModifiers(modifiers);
+				event.when = QHaikuEvent::timestamp(msg);
+				event.key.type = press ? QEvent::KeyPress : QEvent::KeyRelease;
+				event.key.key = qt_keycode;
+				event.key.textLength = 0;
+				const char* bytes;
+				if (msg->FindString("bytes", &bytes) == B_OK) {
+					// Cut overlong text at a character boundary.
+					size_t length = strlen(bytes);
+					if (length > QHaikuEvent::KeyData::MaxText) {
+						length = QHaikuEvent::KeyData::MaxText;
+						while (length > 0 && (bytes[length] & 0xc0) == 0x80)
+							length--;
+					}
+					memcpy(event.key.text, bytes, length);
+					event.key.textLength = length;
+				}
+				postEvent(event);
 				break;
 			}
 		default:
@@ -214,6 +250,27 @@ void QtHaikuWindow::MessageReceived(BMessage* msg)
 			be_app->PostMessage(B_QUIT_REQUESTED);
 			return;
 		}
+		case kPostEvent:
+		{
+			const void *data = NULL;
+			ssize_t size = 0;
+			if (msg->FindData("event", B_RAW_TYPE, &data, &size) == B_OK
+				&& size == sizeof(QHaikuEvent))
+				postEvent(*static_cast<const QHaikuEvent*>(data));
+			return;
+		}
+		case kFlushFence:
+		{
+			// Everything issued so far was sent while holding the looper
+			// lock, so one Sync() covers all of it.
+			int64 serial = msg->FindInt64("serial");
+			if (!fFlushFence->isSignaled(serial)) {
+				quint64 issued = fFlushFence->issued();
+				fView->Sync();
+				fFlushFence->signal(issued);
+			}
+			return;
+		}
 		case kSizeGripEnable:
 		{
 			if (Look() == B_TITLED_WINDOW_LOOK)
@@ -235,12 +292,21 @@ void QtHaikuWindow::MessageReceived(BMessage* msg)
 			 if (msg->FindFloat("be:wheel_delta_y", &shift_y) != B_OK)
 			 	shift_y = 0;
 
-			 if (shift_y != 0)
-				Q_EMIT wheelEvent(fView->lastLocalMousePoint, fView->lastGlobalMousePoint,
-					-shift_y * 120, Qt::Vertical, fView->hostToQtModifiers(modifiers()));
-			 if (shift_x != 0)
-				Q_EMIT wheelEvent(fView->lastLocalMousePoint, fView->lastGlobalMousePoint,
-					-shift_x * 120, Qt::Horizontal, fView->hostToQtModifiers(modifiers()));
+			 if (shift_x == 0 && shift_y == 0)
+			 	break;
+
+			 QHaikuEvent event;
+			 event.type = QHaikuEvent::Wheel;
+			 event.modifiers = fView->hostToQtModifiers(modifiers());
+			 event.when = QHaikuEvent::timestamp(msg);
+			 event.wheel.localX = fView->lastLocalMousePoint.x();
+			 event.wheel.localY = fView->lastLocalMousePoint.y();
+			 event.wheel.globalX = fView->lastGlobalMousePoint.x();
+			 event.wheel.globalY = fView->lastGlobalMousePoint.y();
+			 event.wheel.deltaX = -shift_x;
+			 event.wheel.deltaY = -shift_y;
+			 event.wheel.fine = shift_x != floorf(shift_x) || shift_y != floorf(shift_y);
+			 postEvent(event);
 			 break;
 		}
 	default:
@@ -255,42 +321,52 @@ void QtHaikuWindow::Zoom(BPoint origin, float w, float h)
 	Q_UNUSED(origin);
 	Q_UNUSED(w);
 	Q_UNUSED(h);
-	Q_EMIT windowZoomed();
+	postEvent(stateEvent(CurrentMessage(), QHaikuEvent::Zoomed));
 }
 
 void QtHaikuWindow::Minimize(bool minimized)
 {
 	BWindow::Minimize(minimized);
-	Q_EMIT windowMinimized(minimized);
+	// Also called by QHaikuWindow, outside of any message.
+	const BMessage *message = find_thread(NULL) == Thread() ? CurrentMessage() : NULL;
+	postEvent(stateEvent(message, QHaikuEvent::Minimized, minimized));
 }
 
 void QtHaikuWindow::FrameResized(float width, float height)
 {
-	Q_EMIT windowResized(QSize(static_cast<int>(width), static_cast<int>(height)));
+	QHaikuEvent event = stateEvent(CurrentMessage(), QHaikuEvent::Resized);
+	event.state.x = static_cast<int>(width);
+	event.state.y = static_cast<int>(height);
+	postEvent(event);
 }
 
 
 void QtHaikuWindow::FrameMoved(BPoint point)
 {
-	Q_EMIT windowMoved(QPoint(point.x, point.y));
+	QHaikuEvent event = stateEvent(CurrentMessage(), QHaikuEvent::Moved);
+	event.state.x = point.x;
+	event.state.y = point.y;
+	postEvent(event);
 }
 
 
 void QtHaikuWindow::WindowActivated(bool active)
 {
-	Q_EMIT windowActivated(active);
+	postEvent(stateEvent(CurrentMessage(), QHaikuEvent::Activated, active));
 }
 
 
 void QtHaikuWindow::WorkspaceActivated(int32 workspace, bool active)
 {
-	Q_EMIT workspaceActivated(workspace, active);
+	QHaikuEvent event = stateEvent(CurrentMessage(), QHaikuEvent::WorkspaceActivated, active);
+	event.state.workspace = workspace;
+	postEvent(event);
 }
 
 
 bool QtHaikuWindow::QuitRequested()
 {
-	Q_EMIT quitRequested();
+	postEvent(stateEvent(CurrentMessage(), QHaikuEvent::QuitRequested));
     return false;
 }
 
@@ -306,8 +382,17 @@ QHaikuWindow::QHaikuWindow(QWindow *wnd)
     , m_window(NULL)
     , m_parent(NULL)
     , m_topLevel(NULL)
-    , m_openGLBufferBitmap(NULL)
     , m_openGLRenderBitmap(NULL)
+    , m_openGLBitmapComplete(false)
+    , m_lastSwapFrame(0)
+    , m_backingStore(NULL)
+    , m_minimized(false)
+    , m_onCurrentWorkspace(true)
+    , m_eventNotifier(NULL)
+    , m_pointerHistory(false)
+    , m_wheelPhase(Qt::NoScrollPhase)
+    , m_wheelChild(false)
+    , m_wheelModifiers(Qt::NoModifier)
 {
 	m_fakeChildWindow.clear();
 
@@ -325,27 +410,21 @@ QHaikuWindow::QHaikuWindow(QWindow *wnd)
 
 	qRegisterMetaType<QMimeData*>();
 
-	connect(m_window, SIGNAL(quitRequested()), SLOT(platformWindowQuitRequested()));
-    connect(m_window, SIGNAL(windowMoved(QPoint)), SLOT(platformWindowMoved(QPoint)));
-	connect(m_window, SIGNAL(windowResized(QSize)), SLOT(platformWindowResized(QSize)));
-    connect(m_window, SIGNAL(windowActivated(bool)), SLOT(platformWindowActivated(bool)));
-    connect(m_window, SIGNAL(workspaceActivated(int, bool)), SLOT(platformWorkspaceActivated(int, bool)));
-    connect(m_window, SIGNAL(windowZoomed()), SLOT(platformWindowZoomed()));
-    connect(m_window, SIGNAL(windowMinimized(bool)), SLOT(platformWindowMinimized(bool)));
+	// Input and state changes come through the event ring, only events
+	// carrying heap data still travel as queued signals.
+	m_eventRing = m_window->fEventRing;
+	if (m_eventRing->isValid()) {
+		m_eventNotifier = new QSocketNotifier(m_eventRing->wakeupDescriptor(), QSocketNotifier::Read, this);
+		connect(m_eventNotifier, SIGNAL(activated(QSocketDescriptor, QSocketNotifier::Type)), SLOT(platformEvents()));
+	}
+
     connect(m_window, SIGNAL(dropAction(BMessage*)), SLOT(platformDropAction(BMessage*)));
-	connect(m_window, SIGNAL(wheelEvent(QPoint, QPoint, int, Qt::Orientation, Qt::KeyboardModifiers)),
-		this, SLOT(platformWheelEvent(QPoint, QPoint, int, Qt::Orientation, Qt::KeyboardModifiers)));
-	connect(m_window, SIGNAL(keyEvent(QEvent::Type, int, Qt::KeyboardModifiers, QString)),
-		this, SLOT(platformKeyEvent(QEvent::Type, int, Qt::KeyboardModifiers, QString)));
-
-	connect(m_window->View(), SIGNAL(enteredView()), this, SLOT(platformEnteredView()));
-	connect(m_window->View(), SIGNAL(exitedView()), this, SLOT(platformExitedView()));
-	connect(m_window->View(), SIGNAL(mouseEvent(QPoint, QPoint, Qt::MouseButtons, Qt::MouseButton, QEvent::Type, Qt::KeyboardModifiers, Qt::MouseEventSource)),
-		this, SLOT(platformMouseEvent(QPoint, QPoint, Qt::MouseButtons, Qt::MouseButton, QEvent::Type, Qt::KeyboardModifiers, Qt::MouseEventSource)));
+
+	m_wheelEndTimer.setSingleShot(true);
+	m_wheelEndTimer.setInterval(kWheelEndTimeout);
+	connect(&m_wheelEndTimer, SIGNAL(timeout()), SLOT(platformWheelEnd()));
 	connect(m_window->View(), SIGNAL(mouseDragEvent(QPoint, Qt::DropActions, QMimeData*,  Qt::MouseButtons, Qt::KeyboardModifiers)),
 		this, SLOT(platformMouseDragEvent(QPoint, Qt::DropActions, QMimeData*,  Qt::MouseButtons, Qt::KeyboardModifiers)));
-	connect(m_window->View(), SIGNAL(tabletEvent(QPointF, QPointF, int, int, Qt::MouseButtons, float, Qt::KeyboardModifiers)),
-		this, SLOT(platformTabletEvent(QPointF, QPointF, int, int, Qt::MouseButtons, float, Qt::KeyboardModifiers)));
 	connect(m_window->View(), SIGNAL(exposeEvent(QRegion)), this, SLOT(platformExposeEvent(QRegion)));
 
 	if (wnd->title().isEmpty())
@@ -362,16 +441,31 @@ QHaikuWindow::QHaikuWindow(QWindow *wnd)
 
 QHaikuWindow::~QHaikuWindow()
 {
+	QHaikuIntegration *integration = static_cast<QHaikuIntegration*>(QGuiApplicationPrivate::platformIntegration());
+	if (integration != NULL && integration->screen() != NULL)
+		integration->screen()->frameClock()->cancelFrame(this);
+
+	if (m_backingStore != NULL)
+		m_backingStore->windowDestroyed();
+
+	m_flushStats.dump("flush", window());
+	m_swapStats.dump("swap", window());
+	m_eventLatency.dump(window());
+
+	if (integration != NULL && integration->presenter() != NULL)
+		integration->presenter()->cancel(this);
+
 	if (m_window != NULL) {
 		m_window->Lock();
 		m_window->Quit();
 	}
 
-	if (m_openGLBufferBitmap != NULL)
-		delete m_openGLBufferBitmap;
-
-	if (m_openGLRenderBitmap != NULL)
-		delete m_openGLRenderBitmap;
+	if (m_openGLRenderBitmap != NULL) {
+		if (integration != NULL && integration->glBufferPool() != NULL)
+			integration->glBufferPool()->release(m_openGLRenderBitmap);
+		else
+			delete m_openGLRenderBitmap;
+	}
 
 	if (!window()->isTopLevel())
 		topLevelWindow()->fakeChildList()->removeAll(this);
@@ -657,12 +751,29 @@ void QHaikuWindow::setVisible(bool visible)
 		setWindowFlags(window()->flags());
 		if (!m_window->IsHidden() && !window()->parent())
 			m_window->Hide();
+		m_window->View()->setHiddenFromQt();
 		QWindowSystemInterface::handleExposeEvent(window(), QRegion());
 	}
 
 	syncDeskBarVisible();
 
     m_visible = visible;
+	updateBackingStoreRetention();
+}
+
+
+void QHaikuWindow::setBackingStore(QHaikuBackingStore *backingStore)
+{
+	m_backingStore = backingStore;
+	updateBackingStoreRetention();
+}
+
+
+void QHaikuWindow::updateBackingStoreRetention()
+{
+	// Windows nobody can see do not need to keep their pixels around.
+	if (m_backingStore != NULL)
+		m_backingStore->setWindowHidden(!m_visible || m_minimized || !m_onCurrentWorkspace);
 }
 
 
@@ -674,6 +785,14 @@ void QHaikuWindow::requestActivateWindow()
 }
 
 
+void QHaikuWindow::requestUpdate()
+{
+	// Delivered from the screen frame clock on the next display retrace.
+	QHaikuIntegration *integration = static_cast<QHaikuIntegration*>(QGuiApplicationPrivate::platformIntegration());
+	integration->screen()->frameClock()->requestFrame(this);
+}
+
+
 bool QHaikuWindow::startSystemResize(Qt::Edges edges)
 {
 	if (Q_UNLIKELY(window()->flags().testFlag(Qt::MSWindowsFixedSizeDialogHint)) || edges == 0)
@@ -897,37 +1016,64 @@ bool QHaikuWindow::makeCurrent()
 		topLevelWindow()->fakeChildList()->append(this);
 	}
 
+	QHaikuIntegration *integration = static_cast<QHaikuIntegration*>(QGuiApplicationPrivate::platformIntegration());
+	QHaikuGLBufferPool *pool = integration->glBufferPool();
+	const QSize size = window()->size();
+
+	// Resizing within the size class keeps the bitmap, only a new class
+	// swaps it for another one from the pool.
 	if (m_openGLRenderBitmap != NULL) {
-		if (window()->size().width() != m_openGLRenderBitmap->Bounds().IntegerWidth() + 1 ||
-				window()->size().height() != m_openGLRenderBitmap->Bounds().IntegerHeight() + 1) {
-			delete m_openGLRenderBitmap;
+		const QSize sizeClass = QHaikuGLBufferPool::sizeClass(size);
+		if (sizeClass.width() != m_openGLRenderBitmap->Bounds().IntegerWidth() + 1 ||
+				sizeClass.height() != m_openGLRenderBitmap->Bounds().IntegerHeight() + 1) {
+			integration->presenter()->waitForPresent(this);
+			pool->release(m_openGLRenderBitmap);
 			m_openGLRenderBitmap = NULL;
 		}
 	}
 
 	if (m_openGLRenderBitmap == NULL) {
-		m_openGLRenderBitmap = new BBitmap(BRect(0, 0, window()->size().width() - 1, window()->size().height() - 1), B_RGB32);
-		memset(m_openGLRenderBitmap->Bits(), 0, m_openGLRenderBitmap->BitsLength());
+		m_openGLRenderBitmap = pool->acquire(size);
+		if (m_openGLRenderBitmap != NULL)
+			memset(m_openGLRenderBitmap->Bits(), 0, m_openGLRenderBitmap->BitsLength());
+	}
+
+	// The rows of the previous frame are laid out for its own size.
+	if (size != m_openGLBitmapSize) {
+		m_openGLBitmapSize = size;
+		m_openGLBitmapComplete = false;
 	}
 
 	return m_openGLRenderBitmap != NULL;
 }
 
 
-void QHaikuWindow::swapBuffers()
+// Damage is set on the GUI thread and taken by the swap on the render
+// thread. It belongs to the first swap that starts after it was set, damage
+// set again before that swap adds up. A swap that takes the damage of the
+// frame after it only draws more than needed, the frame after it then has
+// none and is drawn whole.
+void QHaikuWindow::setOpenGLDamage(const QRegion &damage)
 {
-	if (m_openGLBufferBitmap != NULL) {
-		if (m_openGLRenderBitmap->Bounds().IntegerWidth() != m_openGLBufferBitmap->Bounds().IntegerWidth() ||
-				m_openGLRenderBitmap->Bounds().IntegerHeight() != m_openGLBufferBitmap->Bounds().IntegerHeight()) {
-			delete m_openGLBufferBitmap;
-			m_openGLBufferBitmap = NULL;
-		}
-	}
+	QMutexLocker locker(&m_openGLDamageMutex);
+	m_openGLDamage += damage;
+}
+
+
+QRegion QHaikuWindow::takeOpenGLDamage()
+{
+	QMutexLocker locker(&m_openGLDamageMutex);
+	QRegion damage = m_openGLDamage;
+	m_openGLDamage = QRegion();
+	return damage;
+}
 
-	if (m_openGLBufferBitmap == NULL)
-		m_openGLBufferBitmap = new BBitmap(m_openGLRenderBitmap->Bounds(), B_RGB32);
 
-	memcpy(m_openGLBufferBitmap->Bits(), m_openGLRenderBitmap->Bits(), m_openGLRenderBitmap->BitsLength());
+QSharedPointer<QHaikuFlushFence> QHaikuWindow::flushFence() const
+{
+	if (m_window == NULL)
+		return QSharedPointer<QHaikuFlushFence>();
+	return m_window->fFlushFence;
 }
 
 
@@ -953,6 +1099,176 @@ BRegion QHaikuWindow::getClippingRegion()
 }
 
 
+void QHaikuWindow::platformEvents()
+{
+	drainEvents();
+}
+
+
+bool QHaikuWindow::drainEvents()
+{
+	// Handlers may close the window and delete it along the way.
+	QPointer<QHaikuWindow> guard(this);
+	QSharedPointer<QHaikuEventRing> ring = m_eventRing;
+
+	ring->acknowledge();
+	QHaikuEvent event;
+	while (ring->pop(&event)) {
+		if (!m_pointerHistory && isMotionSuperseded(event))
+			continue;
+		if (event.type == QHaikuEvent::Wheel)
+			coalesceWheel(&event);
+		dispatchEvent(event);
+		if (guard.isNull())
+			return false;
+	}
+	return true;
+}
+
+
+static bool isMotion(const QHaikuEvent &event)
+{
+	return event.type == QHaikuEvent::Tablet
+		|| (event.type == QHaikuEvent::Mouse && event.mouse.type == QEvent::MouseMove);
+}
+
+
+static uint32 motionButtons(const QHaikuEvent &event)
+{
+	return event.type == QHaikuEvent::Tablet ? event.tablet.buttons : event.mouse.buttons;
+}
+
+
+// A motion event still queued behind a newer one of the same kind and
+// button state is dropped, the more the Qt thread lags behind, the more
+// moves collapse into their latest position. Anything else queued in
+// between keeps the order intact.
+bool QHaikuWindow::isMotionSuperseded(const QHaikuEvent &event) const
+{
+	if (!isMotion(event))
+		return false;
+
+	QHaikuEvent next;
+	for (int i = 0; m_eventRing->peek(i, &next); i++) {
+		if (!isMotion(next))
+			return false;
+		if (next.type != event.type)
+			continue;
+		return motionButtons(next) == motionButtons(event) && next.modifiers == event.modifiers;
+	}
+	return false;
+}
+
+
+// Wheel events queued back to back are summed into the last one, a fast
+// flick of the wheel or touchpad then scrolls once per drain.
+void QHaikuWindow::coalesceWheel(QHaikuEvent *event)
+{
+	QHaikuEvent next;
+	while (m_eventRing->peek(0, &next) && next.type == QHaikuEvent::Wheel
+		&& next.modifiers == event->modifiers) {
+		m_eventRing->pop(&next);
+		next.wheel.deltaX += event->wheel.deltaX;
+		next.wheel.deltaY += event->wheel.deltaY;
+		next.wheel.fine = next.wheel.fine || event->wheel.fine;
+		*event = next;
+	}
+}
+
+
+void QHaikuWindow::setPointerHistory(bool enabled)
+{
+	if (m_pointerHistory == enabled)
+		return;
+
+	m_pointerHistory = enabled;
+	if (m_window != NULL && m_window->LockLooper()) {
+		m_window->View()->setPointerHistory(enabled);
+		m_window->UnlockLooper();
+	}
+}
+
+
+static QHaikuEventLatency::EventClass latencyClass(const QHaikuEvent &event)
+{
+	switch (event.type) {
+		case QHaikuEvent::Mouse:
+			return event.mouse.type == QEvent::MouseMove ? QHaikuEventLatency::ClassMotion
+				: QHaikuEventLatency::ClassButton;
+		case QHaikuEvent::Tablet:
+			return QHaikuEventLatency::ClassTablet;
+		case QHaikuEvent::Wheel:
+			return QHaikuEventLatency::ClassWheel;
+		case QHaikuEvent::Key:
+			return QHaikuEventLatency::ClassKey;
+		default:
+			return QHaikuEventLatency::ClassWindow;
+	}
+}
+
+
+void QHaikuWindow::dispatchEvent(const QHaikuEvent &event)
+{
+	const Qt::KeyboardModifiers modifiers(event.modifiers);
+	// Qt only compares timestamps with each other, milliseconds since boot
+	// keep them in step with app_server.
+	const ulong timestamp = ulong(event.when / 1000);
+
+	m_eventLatency.addSample(latencyClass(event), system_time() - event.when);
+
+	switch (event.type) {
+		case QHaikuEvent::Mouse:
+			platformMouseEvent(timestamp, QPoint(event.mouse.localX, event.mouse.localY),
+				QPoint(event.mouse.globalX, event.mouse.globalY),
+				Qt::MouseButtons(event.mouse.buttons), Qt::MouseButton(event.mouse.button),
+				QEvent::Type(event.mouse.type), modifiers, Qt::MouseEventSource(event.mouse.source));
+			break;
+		case QHaikuEvent::Tablet:
+			platformTabletEvent(timestamp, QPointF(event.tablet.localX, event.tablet.localY),
+				QPointF(event.tablet.globalX, event.tablet.globalY),
+				event.tablet.device, event.tablet.pointerType,
+				Qt::MouseButtons(event.tablet.buttons), event.tablet.pressure, modifiers);
+			break;
+		case QHaikuEvent::Wheel:
+			platformWheelEvent(timestamp, QPoint(event.wheel.localX, event.wheel.localY),
+				QPoint(event.wheel.globalX, event.wheel.globalY),
+				QPointF(event.wheel.deltaX, event.wheel.deltaY), event.wheel.fine, modifiers);
+			break;
+		case QHaikuEvent::Key:
+			platformKeyEvent(timestamp, QEvent::Type(event.key.type), event.key.key, modifiers,
+				QString::fromUtf8(event.key.text, event.key.textLength));
+			break;
+		case QHaikuEvent::Enter:
+			platformEnteredView();
+			break;
+		case QHaikuEvent::Leave:
+			platformExitedView();
+			break;
+		case QHaikuEvent::Moved:
+			platformWindowMoved(QPoint(event.state.x, event.state.y));
+			break;
+		case QHaikuEvent::Resized:
+			platformWindowResized(QSize(event.state.x, event.state.y));
+			break;
+		case QHaikuEvent::Activated:
+			platformWindowActivated(event.state.active);
+			break;
+		case QHaikuEvent::WorkspaceActivated:
+			platformWorkspaceActivated(event.state.workspace, event.state.active);
+			break;
+		case QHaikuEvent::Zoomed:
+			platformWindowZoomed();
+			break;
+		case QHaikuEvent::Minimized:
+			platformWindowMinimized(event.state.active);
+			break;
+		case QHaikuEvent::QuitRequested:
+			platformWindowQuitRequested();
+			break;
+	}
+}
+
+
 void QHaikuWindow::platformWindowQuitRequested()
 {
     QWindowSystemInterface::handleCloseEvent(window());
@@ -1014,6 +1330,11 @@ void QHaikuWindow::platformWindowActivated(bool activated)
 
 void QHaikuWindow::platformWorkspaceActivated(int workspace, bool activated)
 {
+	m_onCurrentWorkspace = activated;
+	updateBackingStoreRetention();
+	if (!activated)
+		m_window->View()->setHiddenFromQt();
+
 	if (activated)
 		QWindowSystemInterface::handleExposeEvent(window(), window()->geometry());
 }
@@ -1029,7 +1350,11 @@ void QHaikuWindow::platformWindowZoomed()
 
 void QHaikuWindow::platformWindowMinimized(bool minimized)
 {
+	m_minimized = minimized;
+	updateBackingStoreRetention();
+
 	if (minimized) {
+		m_window->View()->setHiddenFromQt();
 		m_lastWindowStates = window()->windowStates();
 		m_lastWindowStates &= ~Qt::WindowMinimized;
 		QWindowSystemInterface::handleWindowStateChanged(window(), Qt::WindowMinimized);
@@ -1040,6 +1365,10 @@ void QHaikuWindow::platformWindowMinimized(bool minimized)
 
 void QHaikuWindow::platformDropAction(BMessage *msg)
 {
+	// Keep the order with what the ring still holds.
+	if (!drainEvents())
+		return;
+
 	if (window()->parent())
 		return;
 	BPoint dropOffset;
@@ -1116,7 +1445,8 @@ void QHaikuWindow::platformExitedView()
     QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(0,0), window()->size()));
 }
 
-void QHaikuWindow::platformMouseEvent(const QPoint &localPosition,
+void QHaikuWindow::platformMouseEvent(ulong timestamp,
+	const QPoint &localPosition,
 	const QPoint &globalPosition,
 	Qt::MouseButtons state,
 	Qt::MouseButton button,
@@ -1126,12 +1456,12 @@ void QHaikuWindow::platformMouseEvent(const QPoint &localPosition,
 {
 	QWindow *childWindow = childWindowAt(window(), globalPosition);
 	if (childWindow) {
-		QWindowSystemInterface::handleMouseEvent(childWindow,
+		QWindowSystemInterface::handleMouseEvent(childWindow, timestamp,
 			childWindow->mapFromGlobal(globalPosition),
 			globalPosition, state, button, type, modifiers, source);
 			QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(0,0), window()->size()));
 	} else {
-		QWindowSystemInterface::handleMouseEvent(window(),
+		QWindowSystemInterface::handleMouseEvent(window(), timestamp,
 			localPosition, globalPosition, state, button, type, modifiers, source);
 
 		if (type == QEvent::MouseButtonPress) {
@@ -1170,29 +1500,97 @@ void QHaikuWindow::platformMouseDragEvent(const QPoint &localPosition,
 	Qt::MouseButtons buttons,
 	Qt::KeyboardModifiers modifiers)
 {
+	if (!drainEvents())
+		return;
+
 	QDragMoveEvent dmEvent(localPosition, actions, data, buttons, modifiers);
 	dmEvent.setDropAction(Qt::CopyAction);
 	dmEvent.accept();
 	QGuiApplication::sendEvent(window(), &dmEvent);
 }
 
-void QHaikuWindow::platformWheelEvent(const QPoint &localPosition,
+// Takes the whole part of an accumulated delta, the fraction is carried
+// over to the next event of the scroll.
+static QPoint takeWholeDelta(QPointF *accumulator)
+{
+	const QPoint whole(int(accumulator->x()), int(accumulator->y()));
+	*accumulator -= whole;
+	return whole;
+}
+
+
+// Wheel steps arrive as one event for both axes. Angles are 1/8 degree,
+// 120 per step, fractions of touchpads and smooth wheels accumulate until
+// they add up. Those devices also get a pixel delta of the lines a step
+// scrolls. A scroll runs from ScrollBegin to ScrollEnd once the wheel was
+// idle for a moment, all of it goes to the window it started over.
+void QHaikuWindow::platformWheelEvent(ulong timestamp,
+	const QPoint &localPosition,
 	const QPoint &globalPosition,
-	int delta,
-	Qt::Orientation orientation,
+	const QPointF &steps,
+	bool fine,
 	Qt::KeyboardModifiers modifiers)
 {
-	const QPoint point = (orientation == Qt::Vertical) ? QPoint(0, delta) : QPoint(delta, 0);
+	if (m_wheelPhase != Qt::NoScrollPhase && modifiers != m_wheelModifiers)
+		platformWheelEnd();
+
+	Qt::ScrollPhase phase = Qt::ScrollUpdate;
+	if (m_wheelPhase == Qt::NoScrollPhase || m_wheelWindow.isNull()) {
+		phase = Qt::ScrollBegin;
+		m_wheelWindow = childWindowAt(window(), globalPosition);
+		m_wheelChild = !m_wheelWindow.isNull();
+		if (!m_wheelChild)
+			m_wheelWindow = window();
+		m_wheelAngle = QPointF();
+		m_wheelPixels = QPointF();
+	}
 
-	QWindow *childWindow = childWindowAt(window(), globalPosition);
-	if (childWindow) {
-		QWindowSystemInterface::handleWheelEvent(childWindow, childWindow->mapFromGlobal(globalPosition), globalPosition, QPoint(), point, modifiers);
+	m_wheelAngle += steps * 120;
+	const QPoint angleDelta = takeWholeDelta(&m_wheelAngle);
+
+	QPoint pixelDelta;
+	if (fine) {
+		const qreal stepPixels = QGuiApplication::styleHints()->wheelScrollLines()
+			* QFontMetricsF(QGuiApplication::font()).lineSpacing();
+		m_wheelPixels += steps * stepPixels;
+		pixelDelta = takeWholeDelta(&m_wheelPixels);
+	}
+
+	m_wheelPhase = phase;
+	m_wheelModifiers = modifiers;
+	m_wheelGlobalPosition = globalPosition;
+	m_wheelEndTimer.start();
+
+	if (angleDelta.isNull() && pixelDelta.isNull() && phase == Qt::ScrollUpdate)
+		return;
+
+	const QPoint position = m_wheelChild ? m_wheelWindow->mapFromGlobal(globalPosition) : localPosition;
+	QWindowSystemInterface::handleWheelEvent(m_wheelWindow, timestamp, position, globalPosition,
+		pixelDelta, angleDelta, modifiers, phase);
+	if (m_wheelChild)
 		QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(0,0), window()->size()));
-	} else
-        QWindowSystemInterface::handleWheelEvent(window(), localPosition, globalPosition, QPoint(), point, modifiers);
 }
 
-void QHaikuWindow::platformTabletEvent(const QPointF &localPosition,
+
+void QHaikuWindow::platformWheelEnd()
+{
+	m_wheelEndTimer.stop();
+	if (m_wheelPhase == Qt::NoScrollPhase)
+		return;
+
+	m_wheelPhase = Qt::NoScrollPhase;
+	if (m_wheelWindow.isNull())
+		return;
+
+	const ulong timestamp = ulong(system_time() / 1000);
+	QWindowSystemInterface::handleWheelEvent(m_wheelWindow, timestamp,
+		m_wheelWindow->mapFromGlobal(m_wheelGlobalPosition), m_wheelGlobalPosition,
+		QPoint(), QPoint(), m_wheelModifiers, Qt::ScrollEnd);
+	m_wheelWindow.clear();
+}
+
+void QHaikuWindow::platformTabletEvent(ulong timestamp,
+	const QPointF &localPosition,
 	const QPointF &globalPosition,
 	int device,
 	int pointerType,
@@ -1202,24 +1600,27 @@ void QHaikuWindow::platformTabletEvent(const QPointF &localPosition,
 {
 	QWindow *childWindow = childWindowAt(window(), globalPosition.toPoint());
 	if (childWindow) {
-		QWindowSystemInterface::handleTabletEvent(childWindow, childWindow->mapFromGlobal(globalPosition.toPoint()),
+		QWindowSystemInterface::handleTabletEvent(childWindow, timestamp, childWindow->mapFromGlobal(globalPosition.toPoint()),
 			globalPosition,	device, pointerType, buttons, pressure, 0, 0, 0.0, 0.0, 0, 0, modifiers);
 		QWindowSystemInterface::handleExposeEvent(window(), QRect(QPoint(0,0), window()->size()));
 	} else {
-		QWindowSystemInterface::handleTabletEvent(window(), localPosition, globalPosition,
+		QWindowSystemInterface::handleTabletEvent(window(), timestamp, localPosition, globalPosition,
 			device, pointerType, buttons, pressure, 0, 0, 0.0, 0.0, 0, 0, modifiers);
 	}
 	m_lastMousePos = globalPosition.toPoint();
 }
 
 
-void QHaikuWindow::platformKeyEvent(QEvent::Type type, int key, Qt::KeyboardModifiers modifiers, const QString &text)
+void QHaikuWindow::platformKeyEvent(ulong timestamp, QEvent::Type type, int key, Qt::KeyboardModifiers modifiers, const QString &text)
 {
-    QWindowSystemInterface::handleKeyEvent(window(), type, key, modifiers, text);
+    QWindowSystemInterface::handleKeyEvent(window(), timestamp, type, key, modifiers, text);
 }
 
 void QHaikuWindow::platformExposeEvent(QRegion region)
 {
+	if (!drainEvents())
+		return;
+
 	QWindowSystemInterface::handleExposeEvent<QWindowSystemInterface::SynchronousDelivery>(window(), region);
 }
 
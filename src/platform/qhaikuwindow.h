@@ -58,8 +58,14 @@
 #include <Roster.h>
 
 #include <qhash.h>
+#include <qmutex.h>
+#include <qpointer.h>
+#include <qsocketnotifier.h>
+#include <qtimer.h>
 
 #include "qhaikubackingstore.h"
+#include "qhaikueventring.h"
+#include "qhaikuframestats.h"
 #include "qhaikuscreen.h"
 #include "qhaikuview.h"
 
@@ -68,6 +74,8 @@
 #define kSizeGripDisable	'SGDI'
 #define kSetTitle			'TITL'
 #define kCloseWindow		'CLWN'
+#define kFlushFence			'FLFN'
+#define kPostEvent			'PEVT'
 
 QT_BEGIN_NAMESPACE
 
@@ -93,32 +101,20 @@ public:
 	virtual void Minimize(bool mimimize) override;
 
 	QHaikuSurfaceView *View(void);
+	void postEvent(const QHaikuEvent &event);
 
 	QHaikuSurfaceView *fView;
 	QHaikuWindow *fQWindow;
+	QSharedPointer<QHaikuFlushFence> fFlushFence;
+	QSharedPointer<QHaikuEventRing> fEventRing;
 Q_SIGNALS:
-    void windowMoved(const QPoint &pos);
-    void windowResized(const QSize &size);
-    void windowActivated(bool activated);
-    void workspaceActivated(int workspace, bool activated);
-    void windowZoomed();
-    void windowMinimized(bool minimized);
-    void quitRequested();
     void dropAction(BMessage *message);
-	void wheelEvent(const QPoint &localPosition,
-		const QPoint &globalPosition,
-		int delta,
-		Qt::Orientation orientation,
-		Qt::KeyboardModifiers modifiers);
-	void keyEvent(QEvent::Type type,
-		int key,
-		Qt::KeyboardModifiers modifiers,
-		const QString &text);
 };
 
 class QHaikuWindow : public QObject, public QPlatformWindow
 {
 	Q_OBJECT
+	friend class QtHaikuWindow;
 public:
 	QHaikuWindow(QWindow *window);
 	~QHaikuWindow();
@@ -139,6 +135,7 @@ public:
 
 	void setVisible(bool visible) override;
 	void requestActivateWindow() override;
+	void requestUpdate() override;
 
 	bool setKeyboardGrabEnabled(bool) Q_DECL_OVERRIDE { return false; }
 	bool setMouseGrabEnabled(bool) Q_DECL_OVERRIDE { return false; }
@@ -156,19 +153,40 @@ public:
 	void lower() override;
 
 	bool makeCurrent();
-	void swapBuffers();
-	BBitmap *openGLBitmap() { return m_openGLBufferBitmap; }
+	// Mesa reads back straight into the bitmap that is drawn to the view.
+	// It comes from the GL buffer pool and may be larger than the window,
+	// only openGLBitmapSize() of it holds the frame.
+	BBitmap *openGLBitmap() { return m_openGLRenderBitmap; }
+	QSize openGLBitmapSize() const { return m_openGLBitmapSize; }
+	// Damage of the next GL swap, set through the "gldamage" window property
+	// on the GUI thread and taken by the render thread.
+	void setOpenGLDamage(const QRegion &damage);
+	QRegion takeOpenGLDamage();
+	// Display frame of the last GL swap, 0 before the first one.
+	quint64 lastSwapFrame() const { return m_lastSwapFrame; }
+	void setLastSwapFrame(quint64 frame) { m_lastSwapFrame = frame; }
+	bool isOpenGLBitmapComplete() const { return m_openGLBitmapComplete; }
+	void setOpenGLBitmapComplete(bool complete = true) { m_openGLBitmapComplete = complete; }
 	void *openGLBuffer() {
 		return m_openGLRenderBitmap != NULL ? m_openGLRenderBitmap->Bits() : NULL;
 	}
 	QList<QHaikuWindow*> *fakeChildList() { return &m_fakeChildWindow; }
+	QSharedPointer<QHaikuFlushFence> flushFence() const;
 	BRegion getClippingRegion();
+	void setBackingStore(QHaikuBackingStore *backingStore);
+	QHaikuFrameStats *flushStats() { return &m_flushStats; }
+	QHaikuFrameStats *swapStats() { return &m_swapStats; }
+	QHaikuEventLatency *eventLatency() { return &m_eventLatency; }
+	// Every pointer position instead of only the latest, for drawing and
+	// tablet applications, set through the "mousehistory" window property.
+	void setPointerHistory(bool enabled);
 
 private:
 	void setFrameMarginsEnabled(bool enabled);
 	void setGeometryImpl(const QRect &rect);
 	void getDecoratorSize(float* borderWidth, float* tabHeight);
 	void maximizeWindowRespected(bool respected);
+	void updateBackingStoreRetention();
 
 	bool m_systemMoveResizeEnabled;
 	Qt::Edges m_systemResizeEdges;
@@ -189,9 +207,40 @@ private:
 	QHaikuWindow *m_topLevel;
 	QList<QHaikuWindow*> m_fakeChildWindow;
 
-	BBitmap *m_openGLBufferBitmap;
 	BBitmap *m_openGLRenderBitmap;
-private Q_SLOTS:
+	QSize m_openGLBitmapSize;
+	QMutex m_openGLDamageMutex;
+	QRegion m_openGLDamage;
+	bool m_openGLBitmapComplete;
+	quint64 m_lastSwapFrame;
+
+	QHaikuBackingStore *m_backingStore;
+	bool m_minimized;
+	bool m_onCurrentWorkspace;
+
+	QHaikuFrameStats m_flushStats;
+	QHaikuFrameStats m_swapStats;
+	QHaikuEventLatency m_eventLatency;
+
+	QSharedPointer<QHaikuEventRing> m_eventRing;
+	QSocketNotifier *m_eventNotifier;
+	bool m_pointerHistory;
+
+	// Idle time in ms that ends a scroll.
+	enum { kWheelEndTimeout = 100 };
+	Qt::ScrollPhase m_wheelPhase;
+	QPointer<QWindow> m_wheelWindow;
+	bool m_wheelChild;
+	QPointF m_wheelAngle;
+	QPointF m_wheelPixels;
+	Qt::KeyboardModifiers m_wheelModifiers;
+	QPoint m_wheelGlobalPosition;
+	QTimer m_wheelEndTimer;
+
+	bool drainEvents();
+	bool isMotionSuperseded(const QHaikuEvent &event) const;
+	void coalesceWheel(QHaikuEvent *event);
+	void dispatchEvent(const QHaikuEvent &event);
 	void platformWindowQuitRequested();
 	void platformWindowMoved(const QPoint &pos);
 	void platformWindowResized(const QSize &size);
@@ -199,37 +248,44 @@ private Q_SLOTS:
 	void platformWorkspaceActivated(int workspace, bool activated);
 	void platformWindowZoomed();
 	void platformWindowMinimized(bool minimized);
-	void platformDropAction(BMessage *message);
 	void platformEnteredView();
 	void platformExitedView();
-	void platformMouseEvent(const QPoint &localPosition,
+	void platformMouseEvent(ulong timestamp,
+		const QPoint &localPosition,
 		const QPoint &globalPosition,
 		Qt::MouseButtons state,
 		Qt::MouseButton button,
 		QEvent::Type type,
 		Qt::KeyboardModifiers modifiers,
 		Qt::MouseEventSource source);
-	void platformMouseDragEvent(const QPoint &localPosition,
-		Qt::DropActions actions,
-		QMimeData *data,
-		Qt::MouseButtons buttons,
-		Qt::KeyboardModifiers modifiers);
-	void platformWheelEvent(const QPoint &localPosition,
+	void platformWheelEvent(ulong timestamp,
+		const QPoint &localPosition,
 		const QPoint &globalPosition,
-		int delta,
-		Qt::Orientation orientation,
+		const QPointF &steps,
+		bool fine,
 		Qt::KeyboardModifiers modifiers);
-    void platformTabletEvent(const QPointF &localPosition,
+    void platformTabletEvent(ulong timestamp,
+		const QPointF &localPosition,
 		const QPointF &globalPosition,
 		int device,
 		int pointerType,
 		Qt::MouseButtons buttons,
 		float pressure,
 		Qt::KeyboardModifiers modifiers);
-	void platformKeyEvent(QEvent::Type type,
+	void platformKeyEvent(ulong timestamp,
+		QEvent::Type type,
 		int key,
 		Qt::KeyboardModifiers modifiers,
 		const QString &text);
+private Q_SLOTS:
+	void platformEvents();
+	void platformWheelEnd();
+	void platformDropAction(BMessage *message);
+	void platformMouseDragEvent(const QPoint &localPosition,
+		Qt::DropActions actions,
+		QMimeData *data,
+		Qt::MouseButtons buttons,
+		Qt::KeyboardModifiers modifiers);
 	void platformExposeEvent(QRegion region);
 };
 